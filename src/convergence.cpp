@@ -17,6 +17,8 @@
  * loop is on the number of unique cases. For balanced panels, this is    *
  * not useful, but for strongly unbalanced panels, this makes a big       *
  * difference.                                                            *
+ * With 3+ FEs, the same trick is applied to the unique tuples of FEs     *
+ * (identified by hashing, see cpp_fe_tuples).                            *
  *                                                                        *
  * Logit/Negbin:                                                          *
  * To obtain the cluster coefficients for these two likelihoods, I use    *
@@ -24,9 +26,14 @@
  * even when the NR algo would go astray (which may be the case in some   *
  * situations).                                                           *
  *                                                                        *
- * Drawback:                                                              *
- * The big drawback of the ML methods is that, as oppose to GLM metohods, *
- * parallel computing cannot be leveraged.                                *
+ * Parallelism:                                                           *
+ * As opposed to the GLM methods, the FEs are necessarily updated one     *
+ * after the other. Parallelism is then used within each update: the      *
+ * Poisson/Gaussian cluster sums are computed with thread-private         *
+ * accumulators (then reduced), the updates of mu are parallel over the   *
+ * observations and the Negbin/Logit NR are parallel over the clusters.   *
+ * The derivatives are independent across variables: they are solved by  *
+ * tiles of variables, in parallel (see the section on derivatives).      *
  *                                                                        *
  *                                                                        *
  *************************************************************************/
@@ -34,15 +41,24 @@
 #include <Rcpp.h>
 #include <math.h>
 #include <vector>
+#include <chrono>
+#include <thread>
+#include <stdint.h>
 #ifdef _OPENMP
 #include <omp.h>
+#else
+#define omp_get_thread_num() 0
 #endif
+#include "fast_math.h"
 
 // [[Rcpp::plugins(openmp)]]
 
 using namespace Rcpp;
 using std::vector;
 
+// for interruption, defined in demeaning.cpp (only the master thread can call it)
+int pending_interrupt();
+
 // Stopping / continuing criteria
 // Functions used inside all loops
 inline bool continue_criterion(double a, double b, double diffMax){
@@ -85,10 +101,49 @@ struct PARAM_CCC{
 
 };
 
+// Convergence trace:
+// same layout as in cpp_demean, each row is: variable, phase, iter, max_diff, ssr, IT_coef, time
+// there is no phase nor SSR in the ML algorithms => 0 and NA
+const int TRACE_NCOL = 7;
+
+// stride: the i-th value of X is X[i*stride] (see the tiles of the derivatives)
+void trace_add(vector<double> &trace, const std::chrono::steady_clock::time_point &time_start,
+               int v, int iter, int n, const double *X, const double *GX, double IT_coef, int stride = 1){
+
+	double max_diff = 0;
+	for(int i=0 ; i<n ; ++i){
+		double diff = fabs(X[i*stride] - GX[i*stride]);
+		if(diff > max_diff) max_diff = diff;
+	}
+
+	double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - time_start).count();
+
+	trace.push_back(v + 1);
+	trace.push_back(0);
+	trace.push_back(iter);
+	trace.push_back(max_diff);
+	trace.push_back(NA_REAL);
+	trace.push_back(IT_coef);
+	trace.push_back(time);
+}
+
+NumericMatrix trace_to_matrix(const vector<double> &trace){
+	int n_rows = trace.size() / TRACE_NCOL;
+	NumericMatrix res(n_rows, TRACE_NCOL);
+	for(int r=0 ; r<n_rows ; ++r){
+		for(int k=0 ; k<TRACE_NCOL ; ++k){
+			res(r, k) = trace[r*TRACE_NCOL + k];
+		}
+	}
+
+	return(res);
+}
+
 // IT update + returns numerical convergence indicator
+// pIT_coef: if provided, receives the IT coefficient
 bool update_X_IronsTuck(int nb_coef_no_K, vector<double> &X,
                         const vector<double> &GX, const vector<double> &GGX,
-                        vector<double> &delta_GX, vector<double> &delta2_X){
+                        vector<double> &delta_GX, vector<double> &delta2_X, double *pIT_coef = NULL){
 
 	for(int i=0 ; i<nb_coef_no_K ; ++i){
 	    double GX_tmp = GX[i];
@@ -112,8 +167,10 @@ bool update_X_IronsTuck(int nb_coef_no_K, vector<double> &X,
 
 	if(ssq == 0){
 		res = true;
+		if(pIT_coef) *pIT_coef = 0;
 	} else {
 		double coef = vprod/ssq;
+		if(pIT_coef) *pIT_coef = coef;
 
 		// update of X:
 		for(int i=0 ; i<nb_coef_no_K ; ++i){
@@ -124,21 +181,66 @@ bool update_X_IronsTuck(int nb_coef_no_K, vector<double> &X,
 	return(res);
 }
 
-void CCC_poisson(int n_obs, int nb_cluster,
-                 double *cluster_coef, double *exp_mu,
-                 double *sum_y, int *dum){
-	// compute cluster coef, poisson
-	// Rprintf("in gaussian\n");
+// Multithreading of the cluster sums:
+// each thread sums on its own range of observations, then the sums are reduced
+// this is only worth it if the thread-private sums are small wrt the data
+inline bool use_thread_sums(int nthreads, int n_obs, int nb_cluster){
+	return nthreads > 1 && static_cast<double>(nb_cluster) * nthreads <= n_obs;
+}
 
-	// initialize cluster coef
+inline int thread_start(int t, int nthreads, int n_obs){
+	return static_cast<int>(static_cast<double>(t) * n_obs / nthreads);
+}
+
+void reduce_thread_sums(int nthreads, int nb_cluster, const vector<double> &sum_all, double *res){
+	// sum_all: nthreads blocks of length nb_cluster
+
+	#pragma omp parallel for num_threads(nthreads)
 	for(int m=0 ; m<nb_cluster ; ++m){
-		cluster_coef[m] = 0;
+		double value = sum_all[m];
+		for(int t=1 ; t<nthreads ; ++t){
+			value += sum_all[t*nb_cluster + m];
+		}
+		res[m] = value;
 	}
+}
 
-	// looping sequentially over exp_mu
-	for(int i=0 ; i<n_obs ; ++i){
-		cluster_coef[dum[i]] += exp_mu[i];
+void cluster_sum(int nthreads, int n_obs, int nb_cluster, const double *x, const int *dum, double *res){
+	// res[m] = sum of x over the observations of cluster m
+
+	if(use_thread_sums(nthreads, n_obs, nb_cluster)){
+		vector<double> sum_all(nthreads * nb_cluster, 0);
+
+		#pragma omp parallel for num_threads(nthreads)
+		for(int t=0 ; t<nthreads ; ++t){
+			double *my_sum = sum_all.data() + t*nb_cluster;
+			int stop = thread_start(t + 1, nthreads, n_obs);
+			for(int i=thread_start(t, nthreads, n_obs) ; i<stop ; ++i){
+				my_sum[dum[i]] += x[i];
+			}
+		}
+
+		reduce_thread_sums(nthreads, nb_cluster, sum_all, res);
+
+	} else {
+		for(int m=0 ; m<nb_cluster ; ++m){
+			res[m] = 0;
+		}
+
+		for(int i=0 ; i<n_obs ; ++i){
+			res[dum[i]] += x[i];
+		}
 	}
+}
+
+void CCC_poisson(int nthreads, int n_obs, int nb_cluster,
+                 double *cluster_coef, double *exp_mu,
+                 double *sum_y, int *dum){
+	// compute cluster coef, poisson
+	// Rprintf("in gaussian\n");
+
+	// sum of exp_mu within each cluster
+	cluster_sum(nthreads, n_obs, nb_cluster, exp_mu, dum, cluster_coef);
 
 	// calculating cluster coef
 	for(int m=0 ; m<nb_cluster ; ++m){
@@ -148,7 +250,7 @@ void CCC_poisson(int n_obs, int nb_cluster,
 	// "output" is the update of my_cluster_coef
 }
 
-void CCC_poisson_log(int n_obs, int nb_cluster,
+void CCC_poisson_log(int nthreads, int n_obs, int nb_cluster,
                      double *cluster_coef, double *mu,
                      double *sum_y, int *dum){
 	// compute cluster coef, poisson
@@ -156,6 +258,50 @@ void CCC_poisson_log(int n_obs, int nb_cluster,
 	// Thus high chance there are very high values of the cluster coefs (in abs value)
 	// we need to take extra care in computing it => we apply trick of substracting the max in the exp
 
+	if(use_thread_sums(nthreads, n_obs, nb_cluster)){
+		// same algorithm, with thread-private max and sums
+
+		vector<double> mu_max_all(nthreads * nb_cluster, -INFINITY);
+		vector<double> sum_all(nthreads * nb_cluster, 0);
+
+		// max mu for each cluster
+		#pragma omp parallel for num_threads(nthreads)
+		for(int t=0 ; t<nthreads ; ++t){
+			double *my_max = mu_max_all.data() + t*nb_cluster;
+			int stop = thread_start(t + 1, nthreads, n_obs);
+			for(int i=thread_start(t, nthreads, n_obs) ; i<stop ; ++i){
+				if(mu[i] > my_max[dum[i]]) my_max[dum[i]] = mu[i];
+			}
+		}
+
+		double *mu_max = mu_max_all.data();
+		#pragma omp parallel for num_threads(nthreads)
+		for(int m=0 ; m<nb_cluster ; ++m){
+			for(int t=1 ; t<nthreads ; ++t){
+				if(mu_max_all[t*nb_cluster + m] > mu_max[m]) mu_max[m] = mu_max_all[t*nb_cluster + m];
+			}
+		}
+
+		// sum of the exp
+		#pragma omp parallel for num_threads(nthreads)
+		for(int t=0 ; t<nthreads ; ++t){
+			double *my_sum = sum_all.data() + t*nb_cluster;
+			int stop = thread_start(t + 1, nthreads, n_obs);
+			for(int i=thread_start(t, nthreads, n_obs) ; i<stop ; ++i){
+				my_sum[dum[i]] += fm_exp(mu[i] - mu_max[dum[i]]);
+			}
+		}
+
+		reduce_thread_sums(nthreads, nb_cluster, sum_all, cluster_coef);
+
+		// calculating cluster coef
+		for(int m=0 ; m<nb_cluster ; ++m){
+			cluster_coef[m] = log(sum_y[m]) - log(cluster_coef[m]) - mu_max[m];
+		}
+
+		return;
+	}
+
 	vector<double> mu_max(nb_cluster);
 	vector<bool> doInit(nb_cluster);
 
@@ -180,7 +326,7 @@ void CCC_poisson_log(int n_obs, int nb_cluster,
 	// looping sequentially over exp_mu
 	for(int i=0 ; i<n_obs ; ++i){
 		d = dum[i];
-		cluster_coef[d] += exp(mu[i] - mu_max[d]);
+		cluster_coef[d] += fm_exp(mu[i] - mu_max[d]);
 	}
 
 	// calculating cluster coef
@@ -192,20 +338,13 @@ void CCC_poisson_log(int n_obs, int nb_cluster,
 }
 
 
-void CCC_gaussian(int n_obs, int nb_cluster,
+void CCC_gaussian(int nthreads, int n_obs, int nb_cluster,
                   double *cluster_coef, double *mu,
                   double *sum_y, int *dum, int *table){
 	// compute cluster coef, gaussian
 
-	// initialize cluster coef
-	for(int m=0 ; m<nb_cluster ; ++m){
-		cluster_coef[m] = 0;
-	}
-
-	// looping sequentially over mu
-	for(int i=0 ; i<n_obs ; ++i){
-		cluster_coef[dum[i]] += mu[i];
-	}
+	// sum of mu within each cluster
+	cluster_sum(nthreads, n_obs, nb_cluster, mu, dum, cluster_coef);
 
 	// calculating cluster coef
 	for(int m=0 ; m<nb_cluster ; ++m){
@@ -224,6 +363,19 @@ void CCC_negbin(int nthreads, int nb_cluster, double theta, double diffMax_NR,
 	// first we find the min max for each cluster to get the bounds
 	int iterMax = 100, iterFullDicho = 10;
 
+	// We gather mu and theta + lhs in the order of the clusters
+	// => all the loops of the NR are then on contiguous memory
+	int n_obs = cumtable[nb_cluster - 1];
+	vector<double> mu_sorted(n_obs);
+	vector<double> theta_y_sorted(n_obs);
+
+	#pragma omp parallel for num_threads(nthreads)
+	for(int u=0 ; u<n_obs ; ++u){
+		int i = obsCluster[u];
+		mu_sorted[u] = mu[i];
+		theta_y_sorted[u] = theta + lhs[i];
+	}
+
 	// finding the max/min values of mu for each cluster
 	vector<double> borne_inf(nb_cluster);
 	vector<double> borne_sup(nb_cluster);
@@ -234,10 +386,10 @@ void CCC_negbin(int nthreads, int nb_cluster, double theta, double diffMax_NR,
 	for(int m=0 ; m<nb_cluster ; ++m){
 		// the min/max of mu
 		u0 = (m == 0 ? 0 : cumtable[m - 1]);
-		mu_min = mu[obsCluster[u0]];
-		mu_max = mu[obsCluster[u0]];
+		mu_min = mu_sorted[u0];
+		mu_max = mu_sorted[u0];
 		for(int u = 1+u0 ; u<cumtable[m] ; ++u){
-			value = mu[obsCluster[u]];
+			value = mu_sorted[u];
 			if(value < mu_min){
 				mu_min = value;
 			} else if(value > mu_max){
@@ -259,8 +411,11 @@ void CCC_negbin(int nthreads, int nb_cluster, double theta, double diffMax_NR,
 		// we initialise the cluster coefficient at 0 (it should converge to 0 at some point)
 		double x1 = 0;
 		bool keepGoing = true;
-		int iter = 0, i;
+		int iter = 0;
 		int u0 = (m == 0 ? 0 : cumtable[m - 1]);
+		int u_end = cumtable[m];
+		const double *my_mu = mu_sorted.data();
+		const double *my_theta_y = theta_y_sorted.data();
 
 		double value, x0, derivee = 0, exp_mu;
 
@@ -280,10 +435,19 @@ void CCC_negbin(int nthreads, int nb_cluster, double theta, double diffMax_NR,
 			// 1st step: initialisation des bornes
 
 			// computing the value of f(x)
+			// during the NR steps, the derivative is computed in the same pass (one exp per obs)
 			value = sum_y[m];
-			for(int u = u0 ; u<cumtable[m] ; ++u){
-				i = obsCluster[u];
-				value -= (theta + lhs[i]) / (1 + theta*exp(-x1 - mu[i]));
+			if(iter <= iterFullDicho){
+				derivee = 0;
+				for(int u = u0 ; u<u_end ; ++u){
+					exp_mu = fm_exp(x1 + my_mu[u]);
+					value -= my_theta_y[u] / (1 + theta/exp_mu);
+					derivee -= theta * my_theta_y[u] / ( (theta/exp_mu + 1) * (theta + exp_mu) );
+				}
+			} else {
+				for(int u = u0 ; u<u_end ; ++u){
+					value -= my_theta_y[u] / (1 + theta*fm_exp(-x1 - my_mu[u]));
+				}
 			}
 
 			// update of the bounds.
@@ -298,14 +462,6 @@ void CCC_negbin(int nthreads, int nb_cluster, double theta, double diffMax_NR,
 			if(value == 0){
 				keepGoing = false;
 			} else if(iter <= iterFullDicho){
-				// computing the derivative
-				derivee = 0;
-				for(int u = u0 ; u<cumtable[m] ; ++u){
-					i = obsCluster[u];
-					exp_mu = exp(x1 + mu[i]);
-					derivee -= theta * (theta + lhs[i]) / ( (theta/exp_mu + 1) * (theta + exp_mu) );
-				}
-
 				x1 = x0 - value / derivee;
 				// Rprintf("x1: %5.2f\n", x1);
 
@@ -355,15 +511,24 @@ void CCC_logit(int nthreads, int nb_cluster, double diffMax_NR,
 	vector<double> borne_sup(nb_cluster);
 	// attention borne_inf => quand mu est maximal
 
+	// We gather mu in the order of the clusters (contiguous memory in the NR loops)
+	int n_obs = cumtable[nb_cluster - 1];
+	vector<double> mu_sorted(n_obs);
+
+	#pragma omp parallel for num_threads(nthreads)
+	for(int u=0 ; u<n_obs ; ++u){
+		mu_sorted[u] = mu[obsCluster[u]];
+	}
+
 	int u0;
 	double value, mu_min, mu_max;
 	for(int m=0 ; m<nb_cluster ; ++m){
 		// the min/max of mu
 		u0 = (m == 0 ? 0 : cumtable[m - 1]);
-		mu_min = mu[obsCluster[u0]];
-		mu_max = mu[obsCluster[u0]];
+		mu_min = mu_sorted[u0];
+		mu_max = mu_sorted[u0];
 		for(int u = 1+u0 ; u<cumtable[m] ; ++u){
-			value = mu[obsCluster[u]];
+			value = mu_sorted[u];
 			if(value < mu_min){
 				mu_min = value;
 			} else if(value > mu_max){
@@ -390,6 +555,8 @@ void CCC_logit(int nthreads, int nb_cluster, double diffMax_NR,
 		bool keepGoing = true;
 		int iter = 0;
 		int u0 = (m == 0 ? 0 : cumtable[m - 1]);
+		int u_end = cumtable[m];
+		const double *my_mu = mu_sorted.data();
 
 		double value, x0, derivee = 0, exp_mu;
 
@@ -409,9 +576,19 @@ void CCC_logit(int nthreads, int nb_cluster, double diffMax_NR,
 			// 1st step: initialisation des bornes
 
 			// computing the value of f(x)
+			// during the NR steps, the derivative is computed in the same pass (one exp per obs)
 			value = sum_y[m];
-			for(int u = u0 ; u<cumtable[m] ; ++u){
-				value -= 1 / (1 + exp(-x1 - mu[obsCluster[u]]));
+			if(iter <= iterFullDicho){
+				derivee = 0;
+				for(int u = u0 ; u<u_end ; ++u){
+					exp_mu = fm_exp(x1 + my_mu[u]);
+					value -= 1 / (1 + 1/exp_mu);
+					derivee -= 1 / ( (1/exp_mu + 1) * (1 + exp_mu) );
+				}
+			} else {
+				for(int u = u0 ; u<u_end ; ++u){
+					value -= 1 / (1 + fm_exp(-x1 - my_mu[u]));
+				}
 			}
 
 			// update of the bounds.
@@ -426,13 +603,6 @@ void CCC_logit(int nthreads, int nb_cluster, double diffMax_NR,
 			if(value == 0){
 				keepGoing = false;
 			} else if(iter <= iterFullDicho){
-				// computing the derivative
-				derivee = 0;
-				for(int u = u0 ; u<cumtable[m] ; ++u){
-					exp_mu = exp(x1 + mu[obsCluster[u]]);
-					derivee -= 1 / ( (1/exp_mu + 1) * (1 + exp_mu) );
-				}
-
 				x1 = x0 - value / derivee;
 				// Rprintf("x1: %5.2f\n", x1);
 
@@ -485,7 +655,7 @@ void computeClusterCoef_single(int family, int n_obs, int nb_cluster, double the
 
 	switch(family){
 	case 1:
-		CCC_poisson(n_obs, nb_cluster, cluster_coef, mu, sum_y, dum);
+		CCC_poisson(nthreads, n_obs, nb_cluster, cluster_coef, mu, sum_y, dum);
 		break;
 	case 2: // Negbin
 		CCC_negbin(nthreads, nb_cluster, theta, diffMax_NR, cluster_coef, mu, lhs, sum_y, obsCluster, table, cumtable);
@@ -494,10 +664,10 @@ void computeClusterCoef_single(int family, int n_obs, int nb_cluster, double the
 		CCC_logit(nthreads, nb_cluster, diffMax_NR, cluster_coef, mu, sum_y, obsCluster, table, cumtable);
 		break;
 	case 4: // Gaussian
-		CCC_gaussian(n_obs, nb_cluster, cluster_coef, mu, sum_y, dum, table);
+		CCC_gaussian(nthreads, n_obs, nb_cluster, cluster_coef, mu, sum_y, dum, table);
 		break;
 	case 5: // log poisson
-		CCC_poisson_log(n_obs, nb_cluster, cluster_coef, mu, sum_y, dum);
+		CCC_poisson_log(nthreads, n_obs, nb_cluster, cluster_coef, mu, sum_y, dum);
 		break;
 	}
 
@@ -575,6 +745,32 @@ SEXP update_mu_single_cluster(int family, int nb_cluster, double theta, double d
 	return(mu);
 }
 
+// Warm start:
+// the gnl algorithms can start from given FE coefficients (fe_coef_init, same layout
+// as the coefficients: the K FEs one after the other, multiplicative for Poisson)
+// and they return the FE coefficients such that mu_new = mu_init + sum of the FEs
+// (mu_init * product for Poisson).
+// The R function getDummies keeps the coefficients of the previous call (saved_fe_coef)
+// and passes them back, mu_init being then mu without the FEs.
+void init_fe_coef(int family, int nb_coef, SEXP fe_coef_init, double *coef){
+
+	if(Rf_isNull(fe_coef_init)){
+		double neutral = family == 1 ? 1 : 0;
+		for(int i=0 ; i<nb_coef ; ++i){
+			coef[i] = neutral;
+		}
+	} else {
+		if(Rf_length(fe_coef_init) != nb_coef){
+			stop("The length of fe_coef_init is different from the number of FE coefficients.");
+		}
+
+		double *pinit = REAL(fe_coef_init);
+		for(int i=0 ; i<nb_coef ; ++i){
+			coef[i] = pinit[i];
+		}
+	}
+}
+
 void computeClusterCoef(vector<double*> &pcluster_origin, vector<double*> &pcluster_destination,
                         PARAM_CCC *args){
 	// update of the cluster coefficients
@@ -607,6 +803,7 @@ void computeClusterCoef(vector<double*> &pcluster_origin, vector<double*> &pclus
 	// We update each cluster coefficient, starting from K
 
 	// we first set the value of mu_with_coef
+	#pragma omp parallel for num_threads(nthreads)
 	for(int i=0 ; i<n_obs ; ++i){
 		mu_with_coef[i] = mu_init[i];
 	}
@@ -616,10 +813,12 @@ void computeClusterCoef(vector<double*> &pcluster_origin, vector<double*> &pclus
 		double *my_cluster_coef = pcluster_origin[k];
 
 		if(family == 1){ // Poisson
+			#pragma omp parallel for num_threads(nthreads)
 			for(int i=0 ; i<n_obs ; ++i){
 				mu_with_coef[i] *= my_cluster_coef[my_dum[i]];
 			}
 		} else {
+			#pragma omp parallel for num_threads(nthreads)
 			for(int i=0 ; i<n_obs ; ++i){
 				mu_with_coef[i] += my_cluster_coef[my_dum[i]];
 			}
@@ -716,6 +915,7 @@ void computeClusterCoef(vector<double*> &pcluster_origin, vector<double*> &pclus
 			//
 
 
+			#pragma omp parallel for num_threads(nthreads)
 			for(int i=0 ; i<n_obs ; ++i){
 				mu_with_coef[i] = mu_init[i];
 			}
@@ -734,10 +934,12 @@ void computeClusterCoef(vector<double*> &pcluster_origin, vector<double*> &pclus
 				}
 
 				if(family == 1){ // Poisson
+					#pragma omp parallel for num_threads(nthreads)
 					for(int i=0 ; i<n_obs ; ++i){
 						mu_with_coef[i] *= my_cluster_coef[my_dum[i]];
 					}
 				} else {
+					#pragma omp parallel for num_threads(nthreads)
 					for(int i=0 ; i<n_obs ; ++i){
 						mu_with_coef[i] += my_cluster_coef[my_dum[i]];
 					}
@@ -754,7 +956,12 @@ void computeClusterCoef(vector<double*> &pcluster_origin, vector<double*> &pclus
 // [[Rcpp::export]]
 List cpp_conv_acc_gnl(int family, int iterMax, double diffMax, double diffMax_NR, double theta, SEXP nb_cluster_all,
                  SEXP lhs, SEXP mu_init, SEXP dum_vector, SEXP tableCluster_vector,
-                 SEXP sum_y_vector, SEXP cumtable_vector, SEXP obsCluster_vector, int nthreads){
+                 SEXP sum_y_vector, SEXP cumtable_vector, SEXP obsCluster_vector, int nthreads,
+                 int trace_every = 0, SEXP fe_coef_init = R_NilValue){
+
+	// trace_every: if > 0, the convergence trace is saved every trace_every iterations
+	// fe_coef_init: initial FE coefficients (NULL: neutral values)
+	std::chrono::steady_clock::time_point time_start = std::chrono::steady_clock::now();
 
 	//initial variables
 	int K = Rf_length(nb_cluster_all);
@@ -868,16 +1075,7 @@ List cpp_conv_acc_gnl(int family, int iterMax, double diffMax, double diffMax_NR
 	//
 
 	// initialisation of X and then pGX
-	if(family == 1){
-		for(int i=0 ; i<nb_coef ; ++i){
-			X[i] = 1;
-		}
-	} else {
-		for(int i=0 ; i<nb_coef ; ++i){
-			X[i] = 0;
-		}
-	}
-
+	init_fe_coef(family, nb_coef, fe_coef_init, X.data());
 
 	// first iteration
 	computeClusterCoef(pX, pGX, &args);
@@ -903,6 +1101,11 @@ List cpp_conv_acc_gnl(int family, int iterMax, double diffMax, double diffMax_NR
 		}
 	}
 
+	// trace
+	vector<double> trace;
+	int iter_last_trace = -1;
+	double IT_coef = NA_REAL;
+
 	int iter = 0;
 	bool numconv = false;
 	while(keepGoing && iter<iterMax){
@@ -923,7 +1126,7 @@ List cpp_conv_acc_gnl(int family, int iterMax, double diffMax, double diffMax_NR
 
 
 		// X ; update of the cluster coefficient
-		numconv = update_X_IronsTuck(nb_coef_no_K, X, GX, GGX, delta_GX, delta2_X);
+		numconv = update_X_IronsTuck(nb_coef_no_K, X, GX, GGX, delta_GX, delta2_X, &IT_coef);
 		if(numconv) break;
 
 		// if(iter >= iterMax - 3){
@@ -962,6 +1165,15 @@ List cpp_conv_acc_gnl(int family, int iterMax, double diffMax, double diffMax_NR
 			}
 		}
 
+		if(trace_every > 0 && iter % trace_every == 0){
+			trace_add(trace, time_start, 0, iter, nb_coef_no_K, X.data(), GX.data(), IT_coef);
+			iter_last_trace = iter;
+		}
+
+	}
+
+	if(trace_every > 0 && iter_last_trace != iter){
+		trace_add(trace, time_start, 0, iter, nb_coef_no_K, X.data(), GX.data(), IT_coef);
 	}
 
 	//
@@ -1010,9 +1222,14 @@ List cpp_conv_acc_gnl(int family, int iterMax, double diffMax, double diffMax_NR
 
 	List res;
 	res["mu_new"] = mu;
+	res["fe_coef"] = GGX;
 	res["iter"] = iter;
 	res["any_negative_poisson"] = any_negative_poisson;
 
+	if(trace_every > 0){
+		res["trace"] = trace_to_matrix(trace);
+	}
+
 	return(res);
 }
 
@@ -1020,7 +1237,10 @@ List cpp_conv_acc_gnl(int family, int iterMax, double diffMax, double diffMax_NR
 // [[Rcpp::export]]
 List cpp_conv_seq_gnl(int family, int iterMax, double diffMax, double diffMax_NR, double theta, SEXP nb_cluster_all,
                  SEXP lhs, SEXP mu_init, SEXP dum_vector, SEXP tableCluster_vector,
-                 SEXP sum_y_vector, SEXP cumtable_vector, SEXP obsCluster_vector, int nthreads){
+                 SEXP sum_y_vector, SEXP cumtable_vector, SEXP obsCluster_vector, int nthreads,
+                 SEXP fe_coef_init = R_NilValue){
+
+	// fe_coef_init: initial FE coefficients (NULL: neutral values)
 
 	//initial variables
 	int K = Rf_length(nb_cluster_all);
@@ -1081,6 +1301,28 @@ List cpp_conv_seq_gnl(int family, int iterMax, double diffMax, double diffMax_NR
 		mu_with_coef[i] = pmu_init[i];
 	}
 
+	// The FE coefficients: the algorithm computes increments which are accumulated in fe_coef
+	vector<double> fe_coef(nb_coef);
+	init_fe_coef(family, nb_coef, fe_coef_init, fe_coef.data());
+
+	if(!Rf_isNull(fe_coef_init)){
+		int start = 0;
+		for(int k=0 ; k<K ; ++k){
+			int *my_dum = pdum[k];
+			double *my_fe_coef = fe_coef.data() + start;
+			if(family == 1){
+				for(int i=0 ; i<n_obs ; ++i){
+					mu_with_coef[i] *= my_fe_coef[my_dum[i]];
+				}
+			} else {
+				for(int i=0 ; i<n_obs ; ++i){
+					mu_with_coef[i] += my_fe_coef[my_dum[i]];
+				}
+			}
+			start += pcluster[k];
+		}
+	}
+
 	// The cluster coefficients
 	// variables on 1:K
 	vector<double> cluster_coef(nb_coef);
@@ -1142,14 +1384,23 @@ List cpp_conv_seq_gnl(int family, int iterMax, double diffMax, double diffMax_NR
 			//
 
 			// we add the computed value
+			double *my_fe_coef = fe_coef.data() + (pcluster_coef[k] - cluster_coef.data());
 			if(family == 1){
 				for(int i=0 ; i<n_obs ; ++i){
 					mu_with_coef[i] *= my_cluster_coef[my_dum[i]];
 				}
+
+				for(int m=0 ; m<nb_cluster ; ++m){
+					my_fe_coef[m] *= my_cluster_coef[m];
+				}
 			} else {
 				for(int i=0 ; i<n_obs ; ++i){
 					mu_with_coef[i] += my_cluster_coef[my_dum[i]];
 				}
+
+				for(int m=0 ; m<nb_cluster ; ++m){
+					my_fe_coef[m] += my_cluster_coef[m];
+				}
 			}
 
 			// Stopping criterion
@@ -1194,6 +1445,7 @@ List cpp_conv_seq_gnl(int family, int iterMax, double diffMax, double diffMax_NR
 
 	List res;
 	res["mu_new"] = mu;
+	res["fe_coef"] = fe_coef;
 	res["iter"] = iter;
 
 	return(res);
@@ -1221,36 +1473,156 @@ int get_n_cells(IntegerVector index_i, IntegerVector index_j){
 
 
 
-void CCC_poisson_2(const vector<double> &pcluster_origin, vector<double> &pcluster_destination,
-                   int n_i, int n_j, int n_cells,
-                   const vector<int> &mat_row, vector<int> &mat_col, vector<double> &mat_value,
-                   const vector<double> &ca, const vector<double> &cb,
-                   vector<double> &alpha){
+// 2-FEs cell matrices:
+// the cells (i, j) are sorted by i then j (COO: mat_row, mat_col). They are also stored
+// by row (CSR: row_start + mat_col) and by column (CSC: col_start + csc_row, the values
+// being reordered accordingly). This way each half-step of the algorithms is a SpMV
+// in which the rows (resp. columns) are independent => parallel without write conflicts.
+// Since the CSR/CSC orders are the COO order within each row/column, the sums are
+// identical to the ones of the COO loops.
+struct CELLS_2{
+	int n_i;
+	int n_j;
+	int n_cells;
+	// number of threads used in the SpMVs (1 if there are too few cells)
+	int nthreads;
 
-	// alpha = ca / (Ab %m% (cb / (Ab %tm% alpha)))
+	// CSR: the cells of row i are row_start[i] to row_start[i + 1] - 1
+	const int *row_start;
+	const int *mat_col;
 
-	double *beta = pcluster_destination.data() + n_i;
+	// CSC: the cells of column j are col_start[j] to col_start[j + 1] - 1
+	const int *col_start;
+	const int *csc_row;
+};
+
+// minimum number of cells to run the SpMVs in parallel
+const int CELLS_2_PAR_MIN = 100000;
+
+void cells_2_build(int n_i, int n_j, int n_cells, const int *mat_row, const int *mat_col,
+                   int *row_start, int *col_start, int *csc_row, int *csc_cell){
+	// row_start: length n_i + 1, col_start: length n_j + 1
+	// csc_cell: for each element of the CSC, the index of the cell in the COO order
+
+	for(int i=0 ; i<=n_i ; ++i){
+		row_start[i] = 0;
+	}
+
+	for(int j=0 ; j<=n_j ; ++j){
+		col_start[j] = 0;
+	}
+
+	for(int u=0 ; u<n_cells ; ++u){
+		++row_start[mat_row[u] + 1];
+		++col_start[mat_col[u] + 1];
+	}
 
 	for(int i=0 ; i<n_i ; ++i){
-		alpha[i] = 0;
+		row_start[i + 1] += row_start[i];
 	}
 
 	for(int j=0 ; j<n_j ; ++j){
-		beta[j] = 0;
+		col_start[j + 1] += col_start[j];
 	}
 
-	for(int obs=0 ; obs<n_cells ; ++obs){
-		beta[mat_col[obs]] += mat_value[obs]*pcluster_origin[mat_row[obs]];
+	// stable counting sort by column
+	vector<int> pos(col_start, col_start + n_j);
+	for(int u=0 ; u<n_cells ; ++u){
+		int v = pos[mat_col[u]]++;
+		csc_row[v] = mat_row[u];
+		csc_cell[v] = u;
+	}
+}
+
+inline void cells_2_set(CELLS_2 &cells, int n_i, int n_j, int n_cells, const int *row_start,
+                        const int *mat_col, const int *col_start, const int *csc_row, int nthreads){
+	cells.n_i = n_i;
+	cells.n_j = n_j;
+	cells.n_cells = n_cells;
+	cells.nthreads = n_cells >= CELLS_2_PAR_MIN ? nthreads : 1;
+	cells.row_start = row_start;
+	cells.mat_col = mat_col;
+	cells.col_start = col_start;
+	cells.csc_row = csc_row;
+}
+
+// Storage of the CSR/CSC when the cells are built in C++
+struct CELLS_2_STORE{
+	vector<int> row_start;
+	vector<int> col_start;
+	vector<int> csc_row;
+	vector<int> csc_cell;
+};
+
+void cells_2_setup(CELLS_2 &cells, CELLS_2_STORE &store, int n_i, int n_j, int n_cells,
+                   const int *mat_row, const int *mat_col, int nthreads){
+
+	store.row_start.resize(n_i + 1);
+	store.col_start.resize(n_j + 1);
+	store.csc_row.resize(n_cells);
+	store.csc_cell.resize(n_cells);
+
+	cells_2_build(n_i, n_j, n_cells, mat_row, mat_col, store.row_start.data(),
+                  store.col_start.data(), store.csc_row.data(), store.csc_cell.data());
+
+	cells_2_set(cells, n_i, n_j, n_cells, store.row_start.data(), mat_col,
+                store.col_start.data(), store.csc_row.data(), nthreads);
+}
+
+void cells_2_to_csc(int n_cells, const int *csc_cell, const double *value, double *value_csc){
+	for(int v=0 ; v<n_cells ; ++v){
+		value_csc[v] = value[csc_cell[v]];
+	}
+}
+
+inline void cells_2_csc_mult(const CELLS_2 &cells, const double *value_csc, const double *x, double *y){
+	// y[j] = sum over the cells of column j of value * x[i]
+
+	#pragma omp parallel for num_threads(cells.nthreads)
+	for(int j=0 ; j<cells.n_j ; ++j){
+		double value = 0;
+		for(int v=cells.col_start[j] ; v<cells.col_start[j + 1] ; ++v){
+			value += value_csc[v] * x[cells.csc_row[v]];
+		}
+		y[j] = value;
+	}
+}
+
+inline void cells_2_csr_mult_add(const CELLS_2 &cells, const double *value_csr, const double *x, double *y){
+	// y[i] += sum over the cells of row i of value * x[j]
+
+	#pragma omp parallel for num_threads(cells.nthreads)
+	for(int i=0 ; i<cells.n_i ; ++i){
+		double value = y[i];
+		for(int u=cells.row_start[i] ; u<cells.row_start[i + 1] ; ++u){
+			value += value_csr[u] * x[cells.mat_col[u]];
+		}
+		y[i] = value;
 	}
+}
+
+void CCC_poisson_2(const vector<double> &pcluster_origin, vector<double> &pcluster_destination,
+                   const CELLS_2 &cells, const vector<double> &mat_value, const vector<double> &mat_value_csc,
+                   const vector<double> &ca, const vector<double> &cb,
+                   vector<double> &alpha){
+
+	// alpha = ca / (Ab %m% (cb / (Ab %tm% alpha)))
+
+	int n_i = cells.n_i, n_j = cells.n_j;
+	double *beta = pcluster_destination.data() + n_i;
+
+	cells_2_csc_mult(cells, mat_value_csc.data(), pcluster_origin.data(), beta);
 
 	for(int j=0 ; j<n_j ; ++j){
 		beta[j] = cb[j] / beta[j];
 	}
 
-	for(int obs=0 ; obs<n_cells ; ++obs){
-		alpha[mat_row[obs]] += mat_value[obs]*beta[mat_col[obs]];
+	for(int i=0 ; i<n_i ; ++i){
+		alpha[i] = 0;
 	}
 
+	cells_2_csr_mult_add(cells, mat_value.data(), beta, alpha.data());
+
 	for(int i=0 ; i<n_i ; ++i){
 		pcluster_destination[i] = ca[i] / alpha[i];
 	}
@@ -1260,7 +1632,11 @@ void CCC_poisson_2(const vector<double> &pcluster_origin, vector<double> &pclust
 // [[Rcpp::export]]
 List cpp_conv_acc_poi_2(int n_i, int n_j, int n_cells, SEXP index_i, SEXP index_j,
                         SEXP dum_vector, SEXP sum_y_vector,
-                        int iterMax, double diffMax, SEXP exp_mu_in, SEXP order){
+                        int iterMax, double diffMax, SEXP exp_mu_in, SEXP order,
+                        int nthreads = 1, int trace_every = 0){
+
+	// trace_every: if > 0, the convergence trace is saved every trace_every iterations
+	std::chrono::steady_clock::time_point time_start = std::chrono::steady_clock::now();
 
 
 
@@ -1305,6 +1681,13 @@ List cpp_conv_acc_poi_2(int n_i, int n_j, int n_cells, SEXP index_i, SEXP index_
 	mat_col[index_current] = pindex_j[n_obs - 1];
 	mat_value[index_current] = value;
 
+	// CSR/CSC storage
+	CELLS_2 cells;
+	CELLS_2_STORE cells_store;
+	cells_2_setup(cells, cells_store, n_i, n_j, n_cells, mat_row.data(), mat_col.data(), nthreads);
+	vector<double> mat_value_csc(n_cells);
+	cells_2_to_csc(n_cells, cells_store.csc_cell.data(), mat_value.data(), mat_value_csc.data());
+
 	//
 	// IT iteration (preparation)
 	//
@@ -1339,7 +1722,7 @@ List cpp_conv_acc_poi_2(int n_i, int n_j, int n_cells, SEXP index_i, SEXP index_
 	}
 
 	// first iteration
-	CCC_poisson_2(X, GX, n_i, n_j, n_cells, mat_row, mat_col, mat_value, ca, cb, alpha);
+	CCC_poisson_2(X, GX, cells, mat_value, mat_value_csc, ca, cb, alpha);
 
 	// Rprintf("init: ");
 	// for(i=0 ; i<5 ; ++i){
@@ -1362,6 +1745,11 @@ List cpp_conv_acc_poi_2(int n_i, int n_j, int n_cells, SEXP index_i, SEXP index_
 		}
 	}
 
+	// trace
+	vector<double> trace;
+	int iter_last_trace = -1;
+	double IT_coef = NA_REAL;
+
 	bool numconv = false;
 	int iter = 0;
 	while(keepGoing && iter<iterMax){
@@ -1369,7 +1757,7 @@ List cpp_conv_acc_poi_2(int n_i, int n_j, int n_cells, SEXP index_i, SEXP index_
 		++iter;
 
 		// GGX -- origin: GX, destination: GGX
-		CCC_poisson_2(GX, GGX, n_i, n_j, n_cells, mat_row, mat_col, mat_value, ca, cb, alpha);
+		CCC_poisson_2(GX, GGX, cells, mat_value, mat_value_csc, ca, cb, alpha);
 
 		// Rprintf("ggx: ");
 		// for(int i=0 ; i<5 ; ++i){
@@ -1378,7 +1766,7 @@ List cpp_conv_acc_poi_2(int n_i, int n_j, int n_cells, SEXP index_i, SEXP index_
 		// Rprintf("\n");
 
 		// X ; update of the cluster coefficient
-		numconv = update_X_IronsTuck(n_i, X, GX, GGX, delta_GX, delta2_X);
+		numconv = update_X_IronsTuck(n_i, X, GX, GGX, delta_GX, delta2_X, &IT_coef);
 		if(numconv) break;
 
 		// Control for negative values
@@ -1401,7 +1789,7 @@ List cpp_conv_acc_poi_2(int n_i, int n_j, int n_cells, SEXP index_i, SEXP index_
 		// Rprintf("\n");
 
 		// GX -- origin: X, destination: GX
-		CCC_poisson_2(X, GX, n_i, n_j, n_cells, mat_row, mat_col, mat_value, ca, cb, alpha);
+		CCC_poisson_2(X, GX, cells, mat_value, mat_value_csc, ca, cb, alpha);
 
 		// Rprintf("   gx: ");
 		// for(int i=0 ; i<5 ; ++i){
@@ -1418,6 +1806,15 @@ List cpp_conv_acc_poi_2(int n_i, int n_j, int n_cells, SEXP index_i, SEXP index_
 			}
 		}
 
+		if(trace_every > 0 && iter % trace_every == 0){
+			trace_add(trace, time_start, 0, iter, n_i, X.data(), GX.data(), IT_coef);
+			iter_last_trace = iter;
+		}
+
+	}
+
+	if(trace_every > 0 && iter_last_trace != iter){
+		trace_add(trace, time_start, 0, iter, n_i, X.data(), GX.data(), IT_coef);
 	}
 
 	SEXP exp_mu = PROTECT(Rf_allocVector(REALSXP, n_obs));
@@ -1431,7 +1828,7 @@ List cpp_conv_acc_poi_2(int n_i, int n_j, int n_cells, SEXP index_i, SEXP index_
 	// }
 
 	// pour avoir identique a acc_pois
-	CCC_poisson_2(GX, X, n_i, n_j, n_cells, mat_row, mat_col, mat_value, ca, cb, alpha);
+	CCC_poisson_2(GX, X, cells, mat_value, mat_value_csc, ca, cb, alpha);
 	double *beta = X.data() + n_i;
 	for(int obs=0 ; obs<n_obs ; ++obs){
 		pmu[obs] = pexp_mu_in[obs] * X[dum_i[obs]] * beta[dum_j[obs]];
@@ -1450,6 +1847,10 @@ List cpp_conv_acc_poi_2(int n_i, int n_j, int n_cells, SEXP index_i, SEXP index_
 	res["iter"] = iter;
 	res["any_negative_poisson"] = any_negative_poisson;
 
+	if(trace_every > 0){
+		res["trace"] = trace_to_matrix(trace);
+	}
+
 	return(res);
 }
 
@@ -1457,7 +1858,8 @@ List cpp_conv_acc_poi_2(int n_i, int n_j, int n_cells, SEXP index_i, SEXP index_
 // [[Rcpp::export]]
 List cpp_conv_seq_poi_2(int n_i, int n_j, int n_cells, SEXP index_i, SEXP index_j,
                         SEXP dum_vector, SEXP sum_y_vector,
-                        int iterMax, double diffMax, SEXP exp_mu_in, SEXP order){
+                        int iterMax, double diffMax, SEXP exp_mu_in, SEXP order,
+                        int nthreads = 1){
 
 
 
@@ -1502,6 +1904,13 @@ List cpp_conv_seq_poi_2(int n_i, int n_j, int n_cells, SEXP index_i, SEXP index_
 	mat_col[index_current] = pindex_j[n_obs - 1];
 	mat_value[index_current] = value;
 
+	// CSR/CSC storage
+	CELLS_2 cells;
+	CELLS_2_STORE cells_store;
+	cells_2_setup(cells, cells_store, n_i, n_j, n_cells, mat_row.data(), mat_col.data(), nthreads);
+	vector<double> mat_value_csc(n_cells);
+	cells_2_to_csc(n_cells, cells_store.csc_cell.data(), mat_value.data(), mat_value_csc.data());
+
 	// X, X_new => the vector of coefficients
 	vector<double> X_new(n_i+n_j);
 	vector<double> X(n_i+n_j);
@@ -1537,9 +1946,9 @@ List cpp_conv_seq_poi_2(int n_i, int n_j, int n_cells, SEXP index_i, SEXP index_
 
 		// This way I don't need to update the values of X with a loop
 		if(iter % 2 == 1){
-			CCC_poisson_2(X, X_new, n_i, n_j, n_cells, mat_row, mat_col, mat_value, ca, cb, alpha);
+			CCC_poisson_2(X, X_new, cells, mat_value, mat_value_csc, ca, cb, alpha);
 		} else {
-			CCC_poisson_2(X_new, X, n_i, n_j, n_cells, mat_row, mat_col, mat_value, ca, cb, alpha);
+			CCC_poisson_2(X_new, X, cells, mat_value, mat_value_csc, ca, cb, alpha);
 		}
 
 		// double *X_current = (iter % 2 == 1 ? X_new : X);
@@ -1595,7 +2004,7 @@ List cpp_conv_seq_poi_2(int n_i, int n_j, int n_cells, SEXP index_i, SEXP index_
 }
 
 // [[Rcpp::export]]
-List cpp_fixed_cost_gaussian(int n_i, int n_cells, SEXP index_i, SEXP index_j, SEXP order,
+List cpp_fixed_cost_gaussian(int n_i, int n_j, int n_cells, SEXP index_i, SEXP index_j, SEXP order,
                              SEXP invTableCluster_vector, SEXP dum_vector){
 
 	// conversion of R objects
@@ -1653,6 +2062,17 @@ List cpp_fixed_cost_gaussian(int n_i, int n_cells, SEXP index_i, SEXP index_j, S
 	mat_value_Ab[index_current] = value_Ab;
 	mat_value_Ba[index_current] = value_Ba;
 
+	// CSR/CSC storage (the values of Ab are used by row, the ones of Ba by column)
+	SEXP r_row_start = PROTECT(Rf_allocVector(INTSXP, n_i + 1));
+	SEXP r_col_start = PROTECT(Rf_allocVector(INTSXP, n_j + 1));
+	SEXP r_csc_row = PROTECT(Rf_allocVector(INTSXP, n_cells));
+	SEXP r_csc_value_Ba = PROTECT(Rf_allocVector(REALSXP, n_cells));
+	vector<int> csc_cell(n_cells);
+
+	cells_2_build(n_i, n_j, n_cells, mat_row, mat_col, INTEGER(r_row_start), INTEGER(r_col_start),
+               INTEGER(r_csc_row), csc_cell.data());
+	cells_2_to_csc(n_cells, csc_cell.data(), mat_value_Ba, REAL(r_csc_value_Ba));
+
 	// the object returned
 	List res;
 
@@ -1660,63 +2080,44 @@ List cpp_fixed_cost_gaussian(int n_i, int n_cells, SEXP index_i, SEXP index_j, S
 	res["mat_col"] = r_mat_col;
 	res["mat_value_Ab"] = r_mat_value_Ab;
 	res["mat_value_Ba"] = r_mat_value_Ba;
+	res["row_start"] = r_row_start;
+	res["col_start"] = r_col_start;
+	res["csc_row"] = r_csc_row;
+	res["csc_value_Ba"] = r_csc_value_Ba;
 
-	UNPROTECT(4);
+	UNPROTECT(8);
 
 	return(res);
 }
 
 void CCC_gaussian_2(const vector<double> &pcluster_origin, vector<double> &pcluster_destination,
-                    int n_i, int n_j, int n_cells,
-                    int *mat_row, int *mat_col,
-                    double *mat_value_Ab, double *mat_value_Ba,
+                    const CELLS_2 &cells, const double *mat_value_Ab, const double *csc_value_Ba,
                     const vector<double> &a_tilde, vector<double> &beta){
 
 	// alpha = a_tilde + (Ab %m% (Ba %m% alpha))
 
-	// for(int i=0 ; i<n_i ; ++i){
-	// 	alpha[i] = 0;
-	// }
-	//
-	// for(int j=0 ; j<n_j ; ++j){
-	// 	beta[j] = 0;
-	// }
-	//
-	// for(int obs=0 ; obs<n_cells ; ++obs){
-	// 	beta[mat_col[obs]] += mat_value_Ba[obs]*pcluster_origin[mat_row[obs]];
-	// }
-	//
-	// for(int obs=0 ; obs<n_cells ; ++obs){
-	// 	alpha[mat_row[obs]] += mat_value_Ab[obs]*beta[mat_col[obs]];
-	// }
-	//
-	// for(int i=0 ; i<n_i ; ++i){
-	// 	pcluster_destination[i] = a_tilde[i] + alpha[i];
-	// }
-
-	for(int i=0 ; i<n_i ; ++i){
+	for(int i=0 ; i<cells.n_i ; ++i){
 		pcluster_destination[i] = a_tilde[i];
 	}
 
-	for(int j=0 ; j<n_j ; ++j){
-		beta[j] = 0;
-	}
-
-	for(int obs=0 ; obs<n_cells ; ++obs){
-		beta[mat_col[obs]] += mat_value_Ba[obs]*pcluster_origin[mat_row[obs]];
-	}
+	cells_2_csc_mult(cells, csc_value_Ba, pcluster_origin.data(), beta.data());
 
-	for(int obs=0 ; obs<n_cells ; ++obs){
-		pcluster_destination[mat_row[obs]] += mat_value_Ab[obs]*beta[mat_col[obs]];
-	}
+	cells_2_csr_mult_add(cells, mat_value_Ab, beta.data(), pcluster_destination.data());
 
 }
 
 // [[Rcpp::export]]
 List cpp_conv_acc_gau_2(int n_i, int n_j, int n_cells,
                         SEXP r_mat_row, SEXP r_mat_col, SEXP r_mat_value_Ab, SEXP r_mat_value_Ba,
+                        SEXP r_row_start, SEXP r_col_start, SEXP r_csc_row, SEXP r_csc_value_Ba,
                         SEXP dum_vector, SEXP lhs, SEXP invTableCluster_vector,
-                        int iterMax, double diffMax, SEXP mu_in){
+                        int iterMax, double diffMax, SEXP mu_in, int nthreads = 1,
+                        int trace_every = 0){
+
+	// trace_every: if > 0, the convergence trace is saved every trace_every iterations
+	std::chrono::steady_clock::time_point time_start = std::chrono::steady_clock::now();
+
+	// the cell matrices are built in cpp_fixed_cost_gaussian (COO + CSR/CSC)
 
 	//
 	// Setting up
@@ -1728,6 +2129,11 @@ List cpp_conv_acc_gau_2(int n_i, int n_j, int n_cells,
 	int *mat_col = INTEGER(r_mat_col);
 	double *mat_value_Ab = REAL(r_mat_value_Ab);
 	double *mat_value_Ba = REAL(r_mat_value_Ba);
+	double *csc_value_Ba = REAL(r_csc_value_Ba);
+
+	CELLS_2 cells;
+	cells_2_set(cells, n_i, n_j, n_cells, INTEGER(r_row_start), mat_col, INTEGER(r_col_start),
+             INTEGER(r_csc_row), nthreads);
 
 	vector<double> resid(n_obs);
 	double *plhs = REAL(lhs), *pmu_in = REAL(mu_in);
@@ -1856,7 +2262,7 @@ List cpp_conv_acc_gau_2(int n_i, int n_j, int n_cells,
 	}
 
 	// first iteration
-	CCC_gaussian_2(X, GX, n_i, n_j, n_cells, mat_row, mat_col, mat_value_Ab, mat_value_Ba, a_tilde, beta);
+	CCC_gaussian_2(X, GX, cells, mat_value_Ab, csc_value_Ba, a_tilde, beta);
 
 	// Rprintf("  X: ");
 	// for(int i=0 ; i<5 ; ++i){
@@ -1873,6 +2279,11 @@ List cpp_conv_acc_gau_2(int n_i, int n_j, int n_cells,
 
 	// stop("kkk");
 
+	// trace
+	vector<double> trace;
+	int iter_last_trace = -1;
+	double IT_coef = NA_REAL;
+
 	bool numconv = false;
 	bool keepGoing = true;
 	int iter = 0;
@@ -1881,7 +2292,7 @@ List cpp_conv_acc_gau_2(int n_i, int n_j, int n_cells,
 		++iter;
 
 		// GGX -- origin: GX, destination: GGX
-		CCC_gaussian_2(GX, GGX, n_i, n_j, n_cells, mat_row, mat_col, mat_value_Ab, mat_value_Ba, a_tilde, beta);
+		CCC_gaussian_2(GX, GGX, cells, mat_value_Ab, csc_value_Ba, a_tilde, beta);
 
 		// Rprintf("ggx: ");
 		// for(int i=0 ; i<5 ; ++i){
@@ -1890,7 +2301,7 @@ List cpp_conv_acc_gau_2(int n_i, int n_j, int n_cells,
 		// Rprintf("\n");
 
 		// X ; update of the cluster coefficient
-		numconv = update_X_IronsTuck(n_i, X, GX, GGX, delta_GX, delta2_X);
+		numconv = update_X_IronsTuck(n_i, X, GX, GGX, delta_GX, delta2_X, &IT_coef);
 		if(numconv) break;
 
 		// Rprintf("  x: ");
@@ -1900,7 +2311,7 @@ List cpp_conv_acc_gau_2(int n_i, int n_j, int n_cells,
 		// Rprintf("\n");
 
 		// GX -- origin: X, destination: GX
-		CCC_gaussian_2(X, GX, n_i, n_j, n_cells, mat_row, mat_col, mat_value_Ab, mat_value_Ba, a_tilde, beta);
+		CCC_gaussian_2(X, GX, cells, mat_value_Ab, csc_value_Ba, a_tilde, beta);
 
 		// Rprintf("   gx: ");
 		// for(int i=0 ; i<5 ; ++i){
@@ -1917,6 +2328,15 @@ List cpp_conv_acc_gau_2(int n_i, int n_j, int n_cells,
 			}
 		}
 
+		if(trace_every > 0 && iter % trace_every == 0){
+			trace_add(trace, time_start, 0, iter, n_i, X.data(), GX.data(), IT_coef);
+			iter_last_trace = iter;
+		}
+
+	}
+
+	if(trace_every > 0 && iter_last_trace != iter){
+		trace_add(trace, time_start, 0, iter, n_i, X.data(), GX.data(), IT_coef);
 	}
 
 	SEXP mu = PROTECT(Rf_allocVector(REALSXP, n_obs));
@@ -1963,6 +2383,10 @@ List cpp_conv_acc_gau_2(int n_i, int n_j, int n_cells,
 	res["mu_new"] = mu;
 	res["iter"] = iter;
 
+	if(trace_every > 0){
+		res["trace"] = trace_to_matrix(trace);
+	}
+
 	return(res);
 }
 
@@ -1970,8 +2394,11 @@ List cpp_conv_acc_gau_2(int n_i, int n_j, int n_cells,
 // [[Rcpp::export]]
 List cpp_conv_seq_gau_2(int n_i, int n_j, int n_cells,
                         SEXP r_mat_row, SEXP r_mat_col, SEXP r_mat_value_Ab, SEXP r_mat_value_Ba,
+                        SEXP r_row_start, SEXP r_col_start, SEXP r_csc_row, SEXP r_csc_value_Ba,
                         SEXP dum_vector, SEXP lhs, SEXP invTableCluster_vector,
-                        int iterMax, double diffMax, SEXP mu_in){
+                        int iterMax, double diffMax, SEXP mu_in, int nthreads = 1){
+
+	// the cell matrices are built in cpp_fixed_cost_gaussian (COO + CSR/CSC)
 
 	//
 	// Setting up
@@ -1983,6 +2410,11 @@ List cpp_conv_seq_gau_2(int n_i, int n_j, int n_cells,
 	int *mat_col = INTEGER(r_mat_col);
 	double *mat_value_Ab = REAL(r_mat_value_Ab);
 	double *mat_value_Ba = REAL(r_mat_value_Ba);
+	double *csc_value_Ba = REAL(r_csc_value_Ba);
+
+	CELLS_2 cells;
+	cells_2_set(cells, n_i, n_j, n_cells, INTEGER(r_row_start), mat_col, INTEGER(r_col_start),
+             INTEGER(r_csc_row), nthreads);
 
 	vector<double> resid(n_obs);
 	double *plhs = REAL(lhs), *pmu_in = REAL(mu_in);
@@ -2067,9 +2499,9 @@ List cpp_conv_seq_gau_2(int n_i, int n_j, int n_cells,
 
 		// This way I don't need to update the values of X with a loop
 		if(iter % 2 == 1){
-			CCC_gaussian_2(X, X_new, n_i, n_j, n_cells, mat_row, mat_col, mat_value_Ab, mat_value_Ba, a_tilde, beta);
+			CCC_gaussian_2(X, X_new, cells, mat_value_Ab, csc_value_Ba, a_tilde, beta);
 		} else {
-			CCC_gaussian_2(X_new, X, n_i, n_j, n_cells, mat_row, mat_col, mat_value_Ab, mat_value_Ba, a_tilde, beta);
+			CCC_gaussian_2(X_new, X, cells, mat_value_Ab, csc_value_Ba, a_tilde, beta);
 		}
 
 		keepGoing = false;
@@ -2128,22 +2560,583 @@ List cpp_conv_seq_gau_2(int n_i, int n_j, int n_cells,
 
 
 //
-// Maintenant la convergence des derivees
+// Q-FEs trick: FE tuples
 //
 
+// Generalization of the 2-FEs trick to any number of FEs (used for Q >= 3):
+// the observations are collapsed into the unique tuples of FE identifiers.
+// For the Poisson and Gaussian families, the FE updates only depend on sums
+// within the FEs, and these sums can be computed from tuple level statistics:
+// - Poisson:     sum_{i in t} exp_mu_i * prod_k coef_k = S_t * prod_k coef_k with S_t = sum_{i in t} exp_mu_i
+// - log-Poisson: same, with S_t the log-sum-exp of mu within the tuple
+// - Gaussian:    sum_{i in t} (mu_i + sum_k coef_k) = S_t + n_t * sum_k coef_k with S_t = sum_{i in t} mu_i
+// The loops are then on the number of tuples instead of the number of observations.
+
+inline uint64_t tuple_hash(const vector<int*> &pdum, int K, int i){
+	// hash of the FE identifiers of observation i
+	uint64_t h = 0;
+	for(int k=0 ; k<K ; ++k){
+		h ^= static_cast<uint64_t>(pdum[k][i]) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+	}
 
+	// final mix (splitmix64)
+	h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+	return h ^ (h >> 31);
+}
 
 // [[Rcpp::export]]
-List cpp_derivconv_seq_gnl(int iterMax, double diffMax, int n_vars, SEXP nb_cluster_all, SEXP ll_d2,
-                                    SEXP jacob_vector, SEXP deriv_init_vector, SEXP dum_vector){
+List cpp_fe_tuples(SEXP dum_vector, SEXP nb_cluster_all, int nthreads){
+	// dum_vector: the K FE identifiers (0-based) of the observations, one after the other
+	// Returns:
+	// - n_tuples: the number of unique tuples
+	// - tuple_id: tuple of each observation (0-based, in order of appearance)
+	// - tuple_dum: the K FE identifiers of each tuple (K vectors of length n_tuples, one after the other)
+	// - tuple_size: the number of observations in each tuple
 
-	int n_obs = Rf_length(ll_d2);
 	int K = Rf_length(nb_cluster_all);
+	int n_obs = Rf_length(dum_vector) / K;
 
-	int *pcluster = INTEGER(nb_cluster_all);
-	double *pll_d2 = REAL(ll_d2);
+	vector<int*> pdum(K);
+	pdum[0] = INTEGER(dum_vector);
+	for(int k=1 ; k<K ; ++k){
+		pdum[k] = pdum[k - 1] + n_obs;
+	}
 
-	int nb_coef = 0;
+	// the hashes
+	vector<uint64_t> hash(n_obs);
+	#pragma omp parallel for num_threads(nthreads)
+	for(int i=0 ; i<n_obs ; ++i){
+		hash[i] = tuple_hash(pdum, K, i);
+	}
+
+	// open addressing, the table is at least twice as large as the nber of obs
+	int n_bits = 1;
+	while((static_cast<uint64_t>(1) << n_bits) < 2 * static_cast<uint64_t>(n_obs)) ++n_bits;
+	uint64_t mask = (static_cast<uint64_t>(1) << n_bits) - 1;
+	vector<int> table(mask + 1, -1);
+
+	// tuple_first: first observation of each tuple
+	vector<int> tuple_first;
+	vector<int> tuple_size;
+
+	SEXP r_tuple_id = PROTECT(Rf_allocVector(INTSXP, n_obs));
+	int *tuple_id = INTEGER(r_tuple_id);
+
+	for(int i=0 ; i<n_obs ; ++i){
+		uint64_t h = hash[i];
+		uint64_t pos = h & mask;
+		while(true){
+			int t = table[pos];
+			if(t == -1){
+				// new tuple
+				t = tuple_first.size();
+				table[pos] = t;
+				tuple_first.push_back(i);
+				tuple_size.push_back(1);
+				tuple_id[i] = t;
+				break;
+			}
+
+			int i_first = tuple_first[t];
+			bool same = hash[i_first] == h;
+			for(int k=0 ; same && k<K ; ++k){
+				same = pdum[k][i] == pdum[k][i_first];
+			}
+
+			if(same){
+				++tuple_size[t];
+				tuple_id[i] = t;
+				break;
+			}
+
+			pos = (pos + 1) & mask;
+		}
+	}
+
+	int n_tuples = tuple_first.size();
+
+	SEXP r_tuple_dum = PROTECT(Rf_allocVector(INTSXP, K * n_tuples));
+	int *tuple_dum = INTEGER(r_tuple_dum);
+	for(int k=0 ; k<K ; ++k){
+		int *my_tuple_dum = tuple_dum + k*n_tuples;
+		for(int t=0 ; t<n_tuples ; ++t){
+			my_tuple_dum[t] = pdum[k][tuple_first[t]];
+		}
+	}
+
+	List res;
+	res["n_tuples"] = n_tuples;
+	res["tuple_id"] = r_tuple_id;
+	res["tuple_dum"] = r_tuple_dum;
+	res["tuple_size"] = tuple_size;
+
+	UNPROTECT(2);
+
+	return(res);
+}
+
+// Parameters of the algorithm on the FE tuples (Poisson, log-Poisson and Gaussian only)
+struct PARAM_TUPLE{
+	int family;
+	int n_tuples;
+	int K;
+	int nthreads;
+
+	int *pcluster;
+	vector<int*> pdum;
+	vector<int*> ptable;
+	vector<double*> psum_y;
+
+	// tuple level values of mu (S_t) and number of obs per tuple (Gaussian only)
+	double *mu_init;
+	double *tuple_size;
+
+	// value that will vary
+	double *mu_with_coef;
+};
+
+void tuple_setup(int family, int n_obs, int n_tuples, const double *mu_in, const int *tuple_id,
+                 const int *tuple_size, vector<double> &mu_init, vector<double> &size){
+	// computes the tuple level values of mu and, for the Gaussian, the tuple sizes
+
+	if(family == 5){
+		// log-sum-exp within each tuple
+		vector<double> mu_max(n_tuples, -INFINITY);
+		for(int i=0 ; i<n_obs ; ++i){
+			if(mu_in[i] > mu_max[tuple_id[i]]) mu_max[tuple_id[i]] = mu_in[i];
+		}
+
+		for(int t=0 ; t<n_tuples ; ++t){
+			mu_init[t] = 0;
+		}
+
+		for(int i=0 ; i<n_obs ; ++i){
+			mu_init[tuple_id[i]] += fm_exp(mu_in[i] - mu_max[tuple_id[i]]);
+		}
+
+		for(int t=0 ; t<n_tuples ; ++t){
+			mu_init[t] = log(mu_init[t]) + mu_max[t];
+		}
+
+	} else {
+		for(int t=0 ; t<n_tuples ; ++t){
+			mu_init[t] = 0;
+		}
+
+		for(int i=0 ; i<n_obs ; ++i){
+			mu_init[tuple_id[i]] += mu_in[i];
+		}
+	}
+
+	if(family == 4){
+		size.resize(n_tuples);
+		for(int t=0 ; t<n_tuples ; ++t){
+			size[t] = tuple_size[t];
+		}
+	}
+}
+
+void tuple_add_coef(PARAM_TUPLE *args, int k, const double *cluster_coef){
+	// adds the coefficients of the k-th FE to mu_with_coef
+
+	int n_tuples = args->n_tuples;
+	int *my_dum = args->pdum[k];
+	double *mu_with_coef = args->mu_with_coef;
+
+	if(args->family == 1){
+		#pragma omp parallel for num_threads(args->nthreads)
+		for(int t=0 ; t<n_tuples ; ++t){
+			mu_with_coef[t] *= cluster_coef[my_dum[t]];
+		}
+	} else if(args->family == 4){
+		double *size = args->tuple_size;
+		#pragma omp parallel for num_threads(args->nthreads)
+		for(int t=0 ; t<n_tuples ; ++t){
+			mu_with_coef[t] += size[t] * cluster_coef[my_dum[t]];
+		}
+	} else {
+		#pragma omp parallel for num_threads(args->nthreads)
+		for(int t=0 ; t<n_tuples ; ++t){
+			mu_with_coef[t] += cluster_coef[my_dum[t]];
+		}
+	}
+}
+
+void computeClusterCoef_tuple_single(PARAM_TUPLE *args, int k, double *cluster_coef){
+
+	int family = args->family;
+	int n_tuples = args->n_tuples;
+	int nthreads = args->nthreads;
+	int nb_cluster = args->pcluster[k];
+
+	switch(family){
+	case 1:
+		CCC_poisson(nthreads, n_tuples, nb_cluster, cluster_coef, args->mu_with_coef, args->psum_y[k], args->pdum[k]);
+		break;
+	case 4:
+		CCC_gaussian(nthreads, n_tuples, nb_cluster, cluster_coef, args->mu_with_coef, args->psum_y[k], args->pdum[k], args->ptable[k]);
+		break;
+	case 5:
+		CCC_poisson_log(nthreads, n_tuples, nb_cluster, cluster_coef, args->mu_with_coef, args->psum_y[k], args->pdum[k]);
+		break;
+	}
+}
+
+void computeClusterCoef_tuple(vector<double*> &pcluster_origin, vector<double*> &pcluster_destination,
+                              PARAM_TUPLE *args){
+	// same as computeClusterCoef, on the tuples
+
+	int n_tuples = args->n_tuples;
+	int K = args->K;
+	double *mu_init = args->mu_init;
+	double *mu_with_coef = args->mu_with_coef;
+
+	for(int k=K-1 ; k>=0 ; k--){
+		R_CheckUserInterrupt();
+
+		// mu_with_coef: the destination coefs for h > k, the origin ones for h < k
+		#pragma omp parallel for num_threads(args->nthreads)
+		for(int t=0 ; t<n_tuples ; ++t){
+			mu_with_coef[t] = mu_init[t];
+		}
+
+		for(int h=0 ; h<K ; ++h){
+			if(h == k) continue;
+			tuple_add_coef(args, h, h < k ? pcluster_origin[h] : pcluster_destination[h]);
+		}
+
+		computeClusterCoef_tuple_single(args, k, pcluster_destination[k]);
+	}
+}
+
+SEXP tuple_mu_new(int family, int n_obs, int K, const double *mu_in, const vector<int*> &pdum_obs,
+                  const vector<double*> &pcoef, int nthreads){
+	// observation level mu from the FE coefficients
+
+	SEXP mu = PROTECT(Rf_allocVector(REALSXP, n_obs));
+	double *pmu = REAL(mu);
+
+	#pragma omp parallel for num_threads(nthreads)
+	for(int i=0 ; i<n_obs ; ++i){
+		double value = mu_in[i];
+		if(family == 1){
+			for(int k=0 ; k<K ; ++k){
+				value *= pcoef[k][pdum_obs[k][i]];
+			}
+		} else {
+			for(int k=0 ; k<K ; ++k){
+				value += pcoef[k][pdum_obs[k][i]];
+			}
+		}
+		pmu[i] = value;
+	}
+
+	UNPROTECT(1);
+
+	return(mu);
+}
+
+void tuple_param_setup(PARAM_TUPLE &args, int family, int n_tuples, SEXP nb_cluster_all,
+                       SEXP tableCluster_vector, SEXP sum_y_vector, SEXP tuple_dum, int nthreads){
+
+	int K = Rf_length(nb_cluster_all);
+	int *pcluster = INTEGER(nb_cluster_all);
+
+	args.family = family;
+	args.n_tuples = n_tuples;
+	args.K = K;
+	args.nthreads = nthreads;
+	args.pcluster = pcluster;
+
+	args.pdum.resize(K);
+	args.ptable.resize(K);
+	args.psum_y.resize(K);
+	args.pdum[0] = INTEGER(tuple_dum);
+	args.ptable[0] = INTEGER(tableCluster_vector);
+	args.psum_y[0] = REAL(sum_y_vector);
+	for(int k=1 ; k<K ; ++k){
+		args.pdum[k] = args.pdum[k - 1] + n_tuples;
+		args.ptable[k] = args.ptable[k - 1] + pcluster[k - 1];
+		args.psum_y[k] = args.psum_y[k - 1] + pcluster[k - 1];
+	}
+}
+
+// [[Rcpp::export]]
+List cpp_conv_acc_tuple(int family, int iterMax, double diffMax, SEXP nb_cluster_all,
+                        SEXP mu_init, SEXP dum_vector, SEXP tableCluster_vector, SEXP sum_y_vector,
+                        int n_tuples, SEXP tuple_id, SEXP tuple_dum, SEXP tuple_size, int nthreads,
+                        int trace_every = 0){
+
+	// Same algorithm as cpp_conv_acc_gnl, on the FE tuples (see cpp_fe_tuples)
+	// family: 1 (Poisson), 4 (Gaussian) or 5 (log-Poisson)
+
+	if(family != 1 && family != 4 && family != 5){
+		stop("The FE tuples can only be used with the Poisson and Gaussian families.");
+	}
+
+	std::chrono::steady_clock::time_point time_start = std::chrono::steady_clock::now();
+
+	int K = Rf_length(nb_cluster_all);
+	int *pcluster = INTEGER(nb_cluster_all);
+	int n_obs = Rf_length(mu_init);
+	double *pmu_init = REAL(mu_init);
+
+	int nb_coef = 0, nb_coef_no_K = 0;
+	for(int k=0 ; k<K ; ++k){
+		nb_coef += pcluster[k];
+		if(k < K - 1) nb_coef_no_K += pcluster[k];
+	}
+
+	// tuple level values
+	vector<double> mu_init_tuple(n_tuples);
+	vector<double> size;
+	tuple_setup(family, n_obs, n_tuples, pmu_init, INTEGER(tuple_id), INTEGER(tuple_size), mu_init_tuple, size);
+
+	PARAM_TUPLE args;
+	tuple_param_setup(args, family, n_tuples, nb_cluster_all, tableCluster_vector, sum_y_vector, tuple_dum, nthreads);
+	args.mu_init = mu_init_tuple.data();
+	args.tuple_size = size.data();
+
+	vector<double> mu_with_coef(n_tuples);
+	args.mu_with_coef = mu_with_coef.data();
+
+	//
+	// IT iteration (preparation)
+	//
+
+	vector<double> X(nb_coef);
+	vector<double> GX(nb_coef);
+	vector<double> GGX(nb_coef);
+	vector<double*> pX(K);
+	vector<double*> pGX(K);
+	vector<double*> pGGX(K);
+	pX[0] = X.data();
+	pGX[0] = GX.data();
+	pGGX[0] = GGX.data();
+	for(int k=1 ; k<K ; ++k){
+		pX[k] = pX[k - 1] + pcluster[k - 1];
+		pGX[k] = pGX[k - 1] + pcluster[k - 1];
+		pGGX[k] = pGGX[k - 1] + pcluster[k - 1];
+	}
+
+	vector<double> delta_GX(nb_coef_no_K);
+	vector<double> delta2_X(nb_coef_no_K);
+
+	//
+	// the main loop
+	//
+
+	double neutral = family == 1 ? 1 : 0;
+	for(int i=0 ; i<nb_coef ; ++i){
+		X[i] = neutral;
+	}
+
+	// first iteration
+	computeClusterCoef_tuple(pX, pGX, &args);
+
+	bool any_negative_poisson = false;
+
+	bool keepGoing = false;
+	for(int i=0 ; i<nb_coef ; ++i){
+		if(continue_criterion(X[i], GX[i], diffMax)){
+			keepGoing = true;
+			break;
+		}
+	}
+
+	// trace
+	vector<double> trace;
+	int iter_last_trace = -1;
+	double IT_coef = NA_REAL;
+
+	int iter = 0;
+	bool numconv = false;
+	while(keepGoing && iter<iterMax){
+		++iter;
+
+		// GGX -- origin: GX, destination: GGX
+		computeClusterCoef_tuple(pGX, pGGX, &args);
+
+		// X ; update of the cluster coefficient
+		numconv = update_X_IronsTuck(nb_coef_no_K, X, GX, GGX, delta_GX, delta2_X, &IT_coef);
+		if(numconv) break;
+
+		if(family == 1){
+			for(int i=0 ; i<nb_coef_no_K ; ++i){
+				if(X[i] <= 0){
+					any_negative_poisson = true;
+					break;
+				}
+			}
+
+			if(any_negative_poisson){
+				break;
+			}
+		}
+
+		// GX -- origin: X, destination: GX
+		computeClusterCoef_tuple(pX, pGX, &args);
+
+		keepGoing = false;
+		for(int i=0 ; i<nb_coef_no_K ; ++i){
+			if(continue_criterion(X[i], GX[i], diffMax)){
+				keepGoing = true;
+				break;
+			}
+		}
+
+		if(trace_every > 0 && iter % trace_every == 0){
+			trace_add(trace, time_start, 0, iter, nb_coef_no_K, X.data(), GX.data(), IT_coef);
+			iter_last_trace = iter;
+		}
+	}
+
+	if(trace_every > 0 && iter_last_trace != iter){
+		trace_add(trace, time_start, 0, iter, nb_coef_no_K, X.data(), GX.data(), IT_coef);
+	}
+
+	//
+	// We update mu => result (identical to cpp_conv_acc_gnl)
+	//
+
+	computeClusterCoef_tuple(pGX, pGGX, &args);
+
+	vector<int*> pdum_obs(K);
+	pdum_obs[0] = INTEGER(dum_vector);
+	for(int k=1 ; k<K ; ++k){
+		pdum_obs[k] = pdum_obs[k - 1] + n_obs;
+	}
+
+	List res;
+	res["mu_new"] = tuple_mu_new(family, n_obs, K, pmu_init, pdum_obs, pGGX, nthreads);
+	res["iter"] = iter;
+	res["any_negative_poisson"] = any_negative_poisson;
+
+	if(trace_every > 0){
+		res["trace"] = trace_to_matrix(trace);
+	}
+
+	return(res);
+}
+
+// [[Rcpp::export]]
+List cpp_conv_seq_tuple(int family, int iterMax, double diffMax, SEXP nb_cluster_all,
+                        SEXP mu_init, SEXP dum_vector, SEXP tableCluster_vector, SEXP sum_y_vector,
+                        int n_tuples, SEXP tuple_id, SEXP tuple_dum, SEXP tuple_size, int nthreads){
+
+	// Same algorithm as cpp_conv_seq_gnl, on the FE tuples (see cpp_fe_tuples)
+
+	if(family != 1 && family != 4 && family != 5){
+		stop("The FE tuples can only be used with the Poisson and Gaussian families.");
+	}
+
+	int K = Rf_length(nb_cluster_all);
+	int *pcluster = INTEGER(nb_cluster_all);
+	int n_obs = Rf_length(mu_init);
+	double *pmu_init = REAL(mu_init);
+
+	int nb_coef = 0;
+	for(int k=0 ; k<K ; ++k){
+		nb_coef += pcluster[k];
+	}
+
+	vector<double> mu_init_tuple(n_tuples);
+	vector<double> size;
+	tuple_setup(family, n_obs, n_tuples, pmu_init, INTEGER(tuple_id), INTEGER(tuple_size), mu_init_tuple, size);
+
+	PARAM_TUPLE args;
+	tuple_param_setup(args, family, n_tuples, nb_cluster_all, tableCluster_vector, sum_y_vector, tuple_dum, nthreads);
+	args.mu_init = mu_init_tuple.data();
+	args.tuple_size = size.data();
+
+	// mu_with_coef is updated FE after FE
+	vector<double> mu_with_coef(mu_init_tuple);
+	args.mu_with_coef = mu_with_coef.data();
+
+	// cluster_coef: the increments, fe_coef: the FE coefficients
+	double neutral = family == 1 ? 1 : 0;
+	vector<double> cluster_coef(nb_coef);
+	vector<double> fe_coef(nb_coef, neutral);
+	vector<double*> pcluster_coef(K);
+	vector<double*> pfe_coef(K);
+	pcluster_coef[0] = cluster_coef.data();
+	pfe_coef[0] = fe_coef.data();
+	for(int k=1 ; k<K ; ++k){
+		pcluster_coef[k] = pcluster_coef[k - 1] + pcluster[k - 1];
+		pfe_coef[k] = pfe_coef[k - 1] + pcluster[k - 1];
+	}
+
+	bool keepGoing = true;
+	int iter = 1;
+	while(keepGoing && iter <= iterMax){
+		++iter;
+		keepGoing = false;
+
+		for(int k=(K-1) ; k>=0 ; k--){
+			R_CheckUserInterrupt();
+
+			double *my_cluster_coef = pcluster_coef[k];
+			double *my_fe_coef = pfe_coef[k];
+			int nb_cluster = pcluster[k];
+
+			computeClusterCoef_tuple_single(&args, k, my_cluster_coef);
+
+			tuple_add_coef(&args, k, my_cluster_coef);
+
+			if(family == 1){
+				for(int m=0 ; m<nb_cluster ; ++m){
+					my_fe_coef[m] *= my_cluster_coef[m];
+				}
+			} else {
+				for(int m=0 ; m<nb_cluster ; ++m){
+					my_fe_coef[m] += my_cluster_coef[m];
+				}
+			}
+
+			// Stopping criterion
+			if(keepGoing == false){
+				for(int m=0 ; m<nb_cluster ; ++m){
+					if(fabs(my_cluster_coef[m] - neutral) > diffMax){
+						keepGoing = true;
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	vector<int*> pdum_obs(K);
+	pdum_obs[0] = INTEGER(dum_vector);
+	for(int k=1 ; k<K ; ++k){
+		pdum_obs[k] = pdum_obs[k - 1] + n_obs;
+	}
+
+	List res;
+	res["mu_new"] = tuple_mu_new(family, n_obs, K, pmu_init, pdum_obs, pfe_coef, nthreads);
+	res["iter"] = iter;
+
+	return(res);
+}
+
+
+//
+// Maintenant la convergence des derivees
+//
+
+
+
+// [[Rcpp::export]]
+List cpp_derivconv_seq_gnl(int iterMax, double diffMax, int n_vars, SEXP nb_cluster_all, SEXP ll_d2,
+                                    SEXP jacob_vector, SEXP deriv_init_vector, SEXP dum_vector){
+
+	int n_obs = Rf_length(ll_d2);
+	int K = Rf_length(nb_cluster_all);
+
+	int *pcluster = INTEGER(nb_cluster_all);
+	double *pll_d2 = REAL(ll_d2);
+
+	int nb_coef = 0;
 	for(int k=0 ; k<K ; ++k){
 		nb_coef += pcluster[k];
 	}
@@ -2411,10 +3404,456 @@ void computeDerivCoef(vector<double*> &pcoef_origin, vector<double*> &pcoef_dest
 
 
 
+//
+// Derivatives by tiles
+//
+
+// The derivatives wrt each variable are independent systems which share ll_d2 and the FEs.
+// They are solved together, by tiles of variables (columns):
+// - within a tile, the values of the columns are interleaved: the coef m of the column in
+//   slot c is at m*S + c (S: size of the tile), same for the observations. In the sweeps over
+//   the observations, dum[i] and ll_d2[i] are then read once for all the columns and their
+//   values lie in the same cache line
+// - a column leaves its tile as soon as it has converged: its slot is swapped with the last
+//   active slot, the sweeps are only on the active slots
+// - the tiles are solved in parallel
+
+const int DERIV_TILE_MAX = 8;
+// max size, in bytes, of the n_rows x S buffer of a tile (there is one per thread)
+const double DERIV_TILE_MEM = 64.0 * 1024 * 1024;
+
+int deriv_tile_size(int n_vars, int nthreads, int n_rows = 0){
+	// small enough to have at least one tile per thread
+	int size = (n_vars + nthreads - 1) / nthreads;
+	if(size > DERIV_TILE_MAX) size = DERIV_TILE_MAX;
+
+	// and to keep the buffer of the tile within DERIV_TILE_MEM
+	if(n_rows > 0){
+		double size_mem = DERIV_TILE_MEM / (sizeof(double) * static_cast<double>(n_rows));
+		if(size > size_mem) size = static_cast<int>(size_mem);
+	}
+
+	if(size < 1) size = 1;
+
+	return size;
+}
+
+// Solves the tiles 0 to n_tiles - 1 in parallel, iter_tile[t] = tile_fun(t, thread, args)
+// - the tiles are handed out with a shared counter
+// - only the master thread can check for interrupts: once it has no tile left, it keeps
+//   checking until the other threads are done with theirs
+void deriv_run_tiles(int n_tiles, int nthreads, bool *stopnow, int *iter_tile,
+                     int (*tile_fun)(int, int, void*), void *args){
+
+	int next_tile = 0, n_done = 0;
+
+	#pragma omp parallel num_threads(nthreads)
+	{
+		int thread = omp_get_thread_num();
+
+		while(true){
+			int t;
+			#pragma omp atomic capture
+			t = next_tile++;
+
+			if(t >= n_tiles) break;
+
+			iter_tile[t] = tile_fun(t, thread, args);
+
+			#pragma omp atomic
+			++n_done;
+		}
+
+		if(thread == 0){
+			while(!*stopnow){
+				int done;
+				#pragma omp atomic read
+				done = n_done;
+
+				if(done >= n_tiles) break;
+
+				if(pending_interrupt()){
+					*stopnow = true;
+				} else {
+					std::this_thread::sleep_for(std::chrono::milliseconds(5));
+				}
+			}
+		}
+	}
+}
+
+// IT update of the column in slot c + returns numerical convergence indicator
+// same as update_X_IronsTuck
+bool update_X_IronsTuck_tile(int nb_coef_no_K, int S, int c, double *X,
+                             const double *GX, const double *GGX, double &IT_coef){
+
+	// delta_GX %*% delta2_X and crossprod(delta2_X)
+	double vprod = 0, ssq = 0;
+	for(int m=0 ; m<nb_coef_no_K ; ++m){
+		int index = m*S + c;
+		double GX_tmp = GX[index];
+		double delta_GX = GGX[index] - GX_tmp;
+		double delta2_X = delta_GX - GX_tmp + X[index];
+		vprod += delta_GX * delta2_X;
+		ssq += delta2_X * delta2_X;
+	}
+
+	if(ssq == 0){
+		IT_coef = 0;
+		return true;
+	}
+
+	IT_coef = vprod/ssq;
+
+	// update of X:
+	for(int m=0 ; m<nb_coef_no_K ; ++m){
+		int index = m*S + c;
+		X[index] = GGX[index] - IT_coef * (GGX[index] - GX[index]);
+	}
+
+	return false;
+}
+
+bool continue_criterion_tile(int n, int S, int c, const double *X, const double *GX, double diffMax){
+	for(int m=0 ; m<n ; ++m){
+		if(continue_criterion(X[m*S + c], GX[m*S + c], diffMax)){
+			return true;
+		}
+	}
+
+	return false;
+}
+
+inline void swap_tile_values(vector<double> &x, int n, int S, int a, int b){
+	for(int m=0 ; m<n ; ++m){
+		std::swap(x[m*S + a], x[m*S + b]);
+	}
+}
+
+// information common to all the tiles
+struct PARAM_DERIV_TILE{
+	int n_obs;
+	int K;
+	int nb_coef;
+	int nb_coef_no_K;
+
+	int *pcluster;
+	vector<int> coef_start; // position of the first coef of each FE
+	vector<int*> pdum;
+	vector<double*> psum_ll_d2;
+	double *ll_d2;
+
+	// variables
+	vector<double*> pjac;
+	vector<double*> pderiv_init;
+	double *pres; // dxi_dbeta, n_obs x n_vars
+	int n_vars;
+
+	// tiles
+	int S;
+	vector< vector<double> > *pbuffer_all; // deriv_with_coef, one per thread
+
+	// algorithm
+	int iterMax;
+	double diffMax;
+	bool *stopnow;
+
+	// trace
+	int trace_every;
+	vector< vector<double> > *ptrace;
+	std::chrono::steady_clock::time_point time_start;
+};
+
+// a tile of columns
+struct DERIV_TILE{
+	int S;
+	int n_active;
+
+	// by slot
+	vector<int> var;
+	vector<double*> pinit;
+	vector<double*> pderiv; // the result column
+	vector<double> IT_coef;
+	vector<int> iter_last_trace;
+
+	// interleaved, length n_obs x S: the buffer of the thread
+	double *deriv_with_coef;
+
+	// interleaved, length nb_coef x S
+	vector<double> sum_jac_lld2;
+	vector<double> X;
+	vector<double> GX;
+	vector<double> GGX;
+};
+
+void swap_tile_slots(DERIV_TILE &tile, int nb_coef, int a, int b){
+	if(a == b) return;
+
+	std::swap(tile.var[a], tile.var[b]);
+	std::swap(tile.pinit[a], tile.pinit[b]);
+	std::swap(tile.pderiv[a], tile.pderiv[b]);
+	std::swap(tile.IT_coef[a], tile.IT_coef[b]);
+	std::swap(tile.iter_last_trace[a], tile.iter_last_trace[b]);
+
+	// deriv_with_coef needs not be swapped: it is recomputed at each step
+	int S = tile.S;
+	swap_tile_values(tile.sum_jac_lld2, nb_coef, S, a, b);
+	swap_tile_values(tile.X, nb_coef, S, a, b);
+	swap_tile_values(tile.GX, nb_coef, S, a, b);
+	swap_tile_values(tile.GGX, nb_coef, S, a, b);
+}
+
+// deriv_with_coef = deriv_init, for all active columns
+void init_deriv_tile(int n_obs, int n_active, int S, double **pinit, double *deriv_with_coef){
+	for(int i=0 ; i<n_obs ; ++i){
+		double *my_deriv = deriv_with_coef + i*S;
+		for(int c=0 ; c<n_active ; ++c){
+			my_deriv[c] = pinit[c][i];
+		}
+	}
+}
+
+// deriv_with_coef += coefs of one FE, for all active columns
+void add_coef_tile(int n_obs, int n_active, int S, const int *dum, const double *coef, double *deriv_with_coef){
+	for(int i=0 ; i<n_obs ; ++i){
+		const double *my_coef = coef + dum[i]*S;
+		double *my_deriv = deriv_with_coef + i*S;
+		for(int c=0 ; c<n_active ; ++c){
+			my_deriv[c] += my_coef[c];
+		}
+	}
+}
+
+void computeDerivCoef_tile(const double *coef_origin, double *coef_destination,
+                           DERIV_TILE &tile, PARAM_DERIV_TILE *args){
+	// same algorithm as computeDerivCoef, on all the active columns of the tile
+
+	int n_obs = args->n_obs;
+	int K = args->K;
+	int S = tile.S;
+	int n_active = tile.n_active;
+	int *pcluster = args->pcluster;
+	vector<int> &coef_start = args->coef_start;
+	vector<int*> &pdum = args->pdum;
+	double *ll_d2 = args->ll_d2;
+	double **pinit = tile.pinit.data();
+	double *deriv_with_coef = tile.deriv_with_coef;
+
+	// deriv_with_coef: we start with the FEs 1 to K-1
+	init_deriv_tile(n_obs, n_active, S, pinit, deriv_with_coef);
+
+	for(int k=0 ; k<(K-1) ; ++k){
+		add_coef_tile(n_obs, n_active, S, pdum[k], coef_origin + coef_start[k]*S, deriv_with_coef);
+	}
+
+	for(int k=K-1 ; k>=0 ; k--){
+
+		double *my_deriv_coef = coef_destination + coef_start[k]*S;
+		const double *my_sum_jac_lld2 = tile.sum_jac_lld2.data() + coef_start[k]*S;
+		double *my_sum_ll_d2 = args->psum_ll_d2[k];
+		int *my_dum = pdum[k];
+		int nb_cluster = pcluster[k];
+
+		// init the deriv coef
+		for(int m=0 ; m<nb_cluster ; ++m){
+			for(int c=0 ; c<n_active ; ++c){
+				my_deriv_coef[m*S + c] = my_sum_jac_lld2[m*S + c];
+			}
+		}
+
+		// sum the jac and deriv
+		for(int i=0 ; i<n_obs ; ++i){
+			double *my_coef = my_deriv_coef + my_dum[i]*S;
+			const double *my_deriv = deriv_with_coef + i*S;
+			double w = ll_d2[i];
+			for(int c=0 ; c<n_active ; ++c){
+				my_coef[c] += my_deriv[c] * w;
+			}
+		}
+
+		// divide by the LL sum
+		for(int m=0 ; m<nb_cluster ; ++m){
+			for(int c=0 ; c<n_active ; ++c){
+				my_deriv_coef[m*S + c] /= -my_sum_ll_d2[m];
+			}
+		}
+
+		// updating the value of deriv_with_coef (only if necessary)
+		if(k != 0){
+
+			init_deriv_tile(n_obs, n_active, S, pinit, deriv_with_coef);
+
+			for(int h=0 ; h<K ; h++){
+				if(h == k-1) continue;
+
+				const double *coef = h < k-1 ? coef_origin : coef_destination;
+				add_coef_tile(n_obs, n_active, S, pdum[h], coef + coef_start[h]*S, deriv_with_coef);
+			}
+		}
+	}
+}
+
+void deriv_tile_finish(int c, int iter, DERIV_TILE &tile, PARAM_DERIV_TILE *args){
+	// the column in slot c has converged (or reached iterMax):
+	// we save its final deriv and it leaves the active slots
+
+	int n_obs = args->n_obs;
+	int S = tile.S;
+	int v = tile.var[c];
+
+	if(args->trace_every > 0 && tile.iter_last_trace[c] != iter){
+		trace_add((*args->ptrace)[v], args->time_start, v, iter, args->nb_coef_no_K,
+                  tile.X.data() + c, tile.GX.data() + c, tile.IT_coef[c], S);
+	}
+
+	// we compute the deriv based on the cluster coefs
+	double *my_deriv = tile.pderiv[c];
+	double *my_init = tile.pinit[c];
+	for(int i=0 ; i<n_obs ; ++i){
+		my_deriv[i] = my_init[i];
+	}
+
+	for(int k=0 ; k<args->K ; ++k){
+		int *my_dum = args->pdum[k];
+		double *my_deriv_coef = tile.GX.data() + args->coef_start[k]*S + c;
+		for(int i=0 ; i<n_obs ; ++i){
+			my_deriv[i] += my_deriv_coef[my_dum[i]*S];
+		}
+	}
+
+	swap_tile_slots(tile, args->nb_coef, c, tile.n_active - 1);
+	tile.n_active--;
+}
+
+int deriv_acc_tile_gnl(int v_start, int n_cols, double *deriv_with_coef, PARAM_DERIV_TILE *args){
+	// solves the variables v_start to v_start + n_cols - 1
+	// deriv_with_coef: buffer of length n_obs x n_cols, owned by the thread
+	// returns the max number of iterations
+
+	int n_obs = args->n_obs;
+	int K = args->K;
+	int nb_coef = args->nb_coef;
+	int nb_coef_no_K = args->nb_coef_no_K;
+	int iterMax = args->iterMax;
+	double diffMax = args->diffMax;
+	int trace_every = args->trace_every;
+	bool isMaster = omp_get_thread_num() == 0;
+
+	DERIV_TILE tile;
+	int S = n_cols;
+	tile.S = S;
+	tile.n_active = S;
+	tile.var.resize(S);
+	tile.pinit.resize(S);
+	tile.pderiv.resize(S);
+	tile.IT_coef.resize(S, NA_REAL);
+	tile.iter_last_trace.resize(S, -1);
+	tile.deriv_with_coef = deriv_with_coef;
+	tile.sum_jac_lld2.resize(nb_coef * S, 0);
+	tile.X.resize(nb_coef * S, 0);
+	tile.GX.resize(nb_coef * S);
+	tile.GGX.resize(nb_coef * S);
+
+	for(int c=0 ; c<S ; ++c){
+		int v = v_start + c;
+		tile.var[c] = v;
+		tile.pinit[c] = args->pderiv_init[v];
+		tile.pderiv[c] = args->pres + static_cast<long>(v) * n_obs;
+	}
+
+	// the values of sum_jac_lld2
+	for(int k=0 ; k<K ; ++k){
+		int *my_dum = args->pdum[k];
+		double *my_sum_jac_lld2 = tile.sum_jac_lld2.data() + args->coef_start[k]*S;
+		for(int i=0 ; i<n_obs ; ++i){
+			double *my_sum = my_sum_jac_lld2 + my_dum[i]*S;
+			double w = args->ll_d2[i];
+			for(int c=0 ; c<S ; ++c){
+				my_sum[c] += args->pjac[v_start + c][i] * w;
+			}
+		}
+	}
+
+	//
+	// The IT loop
+	//
+
+	double *X = tile.X.data(), *GX = tile.GX.data(), *GGX = tile.GGX.data();
+
+	computeDerivCoef_tile(X, GX, tile, args);
+
+	int iter = 0;
+	while(tile.n_active > 0 && iter < iterMax){
+
+		if(isMaster && pending_interrupt()){
+			*(args->stopnow) = true;
+		}
+		if(*(args->stopnow)) break;
+
+		++iter;
+
+		// origin: GX, destination: GGX
+		computeDerivCoef_tile(GX, GGX, tile, args);
+
+		// X ; update of the cluster coefficient
+		// the slots of the converged columns are swapped with later slots => backward loop
+		for(int c=tile.n_active - 1 ; c>=0 ; --c){
+			bool numconv = update_X_IronsTuck_tile(nb_coef_no_K, S, c, X, GX, GGX, tile.IT_coef[c]);
+			if(numconv){
+				deriv_tile_finish(c, iter, tile, args);
+			}
+		}
+
+		if(tile.n_active == 0) break;
+
+		// origin: X, destination: GX
+		computeDerivCoef_tile(X, GX, tile, args);
+
+		// the stopping criterion
+		for(int c=tile.n_active - 1 ; c>=0 ; --c){
+			bool keepGoing = continue_criterion_tile(nb_coef_no_K, S, c, X, GX, diffMax);
+
+			if(trace_every > 0 && iter % trace_every == 0){
+				int v = tile.var[c];
+				trace_add((*args->ptrace)[v], args->time_start, v, iter, nb_coef_no_K, X + c, GX + c, tile.IT_coef[c], S);
+				tile.iter_last_trace[c] = iter;
+			}
+
+			if(!keepGoing){
+				deriv_tile_finish(c, iter, tile, args);
+			}
+		}
+	}
+
+	// the columns which did not converge
+	for(int c=tile.n_active - 1 ; c>=0 ; --c){
+		deriv_tile_finish(c, iter, tile, args);
+	}
+
+	return iter;
+}
+
+
+int deriv_run_tile_gnl(int t, int thread, void *_args){
+	PARAM_DERIV_TILE *args = (PARAM_DERIV_TILE *) _args;
+
+	int S = args->S;
+	vector<double> &buffer = (*(args->pbuffer_all))[thread];
+	if(buffer.empty()) buffer.resize(static_cast<long>(args->n_obs) * S);
+
+	int v_start = t*S;
+	int n_cols = args->n_vars - v_start < S ? args->n_vars - v_start : S;
+
+	return deriv_acc_tile_gnl(v_start, n_cols, buffer.data(), args);
+}
+
 // [[Rcpp::export]]
 List cpp_derivconv_acc_gnl(int iterMax, double diffMax, int n_vars, SEXP nb_cluster_all, SEXP ll_d2,
-                                    SEXP jacob_vector, SEXP deriv_init_vector, SEXP dum_vector){
+                                    SEXP jacob_vector, SEXP deriv_init_vector, SEXP dum_vector,
+                                    int nthreads = 1, int trace_every = 0){
 
+	// The variables are solved by tiles, in parallel (see the section above)
+	// trace_every: if > 0, the convergence trace is saved every trace_every iterations
 
 	int n_obs = Rf_length(ll_d2);
 	int K = Rf_length(nb_cluster_all);
@@ -2427,6 +3866,12 @@ List cpp_derivconv_acc_gnl(int iterMax, double diffMax, int n_vars, SEXP nb_clus
 		nb_coef += pcluster[k];
 	}
 
+	// variables on 1:(K-1)
+	int nb_coef_no_K = 0;
+	for(int k = 0 ; k<(K-1) ; ++k){
+		nb_coef_no_K += pcluster[k];
+	}
+
 	// Setting up the vectors on variables
 	vector<double*> pjac(n_vars);
 	pjac[0] = REAL(jacob_vector);
@@ -2448,26 +3893,16 @@ List cpp_derivconv_acc_gnl(int iterMax, double diffMax, int n_vars, SEXP nb_clus
 		pderiv_init[v] = pderiv_init[v-1] + n_obs;
 	}
 
-	// the deriv coefficients & sum_ll_d2 & sum_jac_lld2
-	vector<double> deriv_coef(nb_coef);
-	vector<double> sum_ll_d2(nb_coef);
-	vector<double> sum_jac_lld2(nb_coef);
-	vector<double*> pderiv_coef(K);
-	vector<double*> psum_ll_d2(K);
-	vector<double*> psum_jac_lld2(K);
-	pderiv_coef[0] = deriv_coef.data();
-	psum_ll_d2[0] = sum_ll_d2.data();
-	psum_jac_lld2[0] = sum_jac_lld2.data();
+	// sum_ll_d2: shared by all the variables
+	vector<int> coef_start(K, 0);
 	for(int k=1 ; k<K ; ++k){
-		pderiv_coef[k] = pderiv_coef[k-1] + pcluster[k-1];
-		psum_ll_d2[k] = psum_ll_d2[k-1] + pcluster[k-1];
-		psum_jac_lld2[k] = psum_jac_lld2[k-1] + pcluster[k-1];
+		coef_start[k] = coef_start[k-1] + pcluster[k-1];
 	}
 
-	// computing the sum_ll_d2
-	for(int m=0 ; m<nb_coef ; ++m){
-		// init
-		sum_ll_d2[m] = 0;
+	vector<double> sum_ll_d2(nb_coef, 0);
+	vector<double*> psum_ll_d2(K);
+	for(int k=0 ; k<K ; ++k){
+		psum_ll_d2[k] = sum_ll_d2.data() + coef_start[k];
 	}
 
 	for(int k=0 ; k<K ; ++k){
@@ -2478,196 +3913,430 @@ List cpp_derivconv_acc_gnl(int iterMax, double diffMax, int n_vars, SEXP nb_clus
 		}
 	}
 
-	vector<double> deriv_with_coef(n_obs);
+	NumericMatrix dxi_dbeta(n_obs, n_vars);
 
 	//
 	// Sending the information
 	//
 
-	PARAM_DERIV_COEF args;
+	bool stopnow = false;
+	vector< vector<double> > trace_all(n_vars);
+
+	PARAM_DERIV_TILE args;
 	args.n_obs = n_obs;
 	args.K = K;
+	args.nb_coef = nb_coef;
+	args.nb_coef_no_K = nb_coef_no_K;
+	args.pcluster = pcluster;
+	args.coef_start = coef_start;
 	args.pdum = pdum;
 	args.psum_ll_d2 = psum_ll_d2;
-	args.psum_jac_lld2 = psum_jac_lld2;
-	args.pcluster = pcluster;
 	args.ll_d2 = pll_d2;
-	args.deriv_with_coef = deriv_with_coef.data();
+	args.pjac = pjac;
+	args.pderiv_init = pderiv_init;
+	args.pres = REAL(dxi_dbeta);
+	args.iterMax = iterMax;
+	args.diffMax = diffMax;
+	args.stopnow = &stopnow;
+	args.trace_every = trace_every;
+	args.ptrace = &trace_all;
+	args.time_start = std::chrono::steady_clock::now();
 
 	//
-	// IT iteration (preparation)
+	// Loop on the tiles
 	//
 
-	// variables on 1:K
-	vector<double> X(nb_coef);
-	vector<double> GX(nb_coef);
-	vector<double> GGX(nb_coef);
-	// pointers:
-	vector<double*> pX(K);
-	vector<double*> pGX(K);
-	vector<double*> pGGX(K);
+	int S = deriv_tile_size(n_vars, nthreads, n_obs);
+	int n_tiles = (n_vars + S - 1) / S;
+	vector<int> iter_tile(n_tiles, 0);
 
-	pX[0] = X.data();
-	pGX[0] = GX.data();
-	pGGX[0] = GGX.data();
+	// one deriv_with_coef buffer per thread, reused across its tiles
+	int n_buffers = nthreads < n_tiles ? nthreads : n_tiles;
+	vector< vector<double> > buffer_all(n_buffers);
 
-	for(int k=1 ; k<K ; ++k){
-		pX[k] = pX[k - 1] + pcluster[k - 1];
-		pGX[k] = pGX[k - 1] + pcluster[k - 1];
-		pGGX[k] = pGGX[k - 1] + pcluster[k - 1];
+	args.n_vars = n_vars;
+	args.S = S;
+	args.pbuffer_all = &buffer_all;
+
+	deriv_run_tiles(n_tiles, n_buffers, &stopnow, iter_tile.data(), deriv_run_tile_gnl, &args);
+
+	if(stopnow){
+		stop("cpp_derivconv_acc_gnl: User interrupt.");
 	}
 
-	// variables on 1:(K-1)
-	int nb_coef_no_K = 0;
-	for(int k = 0 ; k<(K-1) ; ++k){
-		nb_coef_no_K += pcluster[k];
+	int iter_all_max = 0;
+	for(int t=0 ; t<n_tiles ; ++t){
+		if(iter_tile[t] > iter_all_max) iter_all_max = iter_tile[t];
+	}
+
+	List res;
+	res["dxi_dbeta"] = dxi_dbeta;
+	res["iter"] = iter_all_max;
+
+	if(trace_every > 0){
+		vector<double> trace;
+		for(int v=0 ; v<n_vars ; ++v){
+			trace.insert(trace.end(), trace_all[v].begin(), trace_all[v].end());
+		}
+		res["trace"] = trace_to_matrix(trace);
+	}
+
+	return(res);
+}
+
+void computeDerivCoef_2(vector<double> &alpha_origin, vector<double> &alpha_destination,
+                        const CELLS_2 &cells, const vector<double> &a_tilde,
+                        const vector<double> &mat_value_Ab, const vector<double> &csc_value_Ba,
+                        vector<double> &beta){
+
+	// a_tile + Ab * Ba * alpha
+
+	for(int m=0 ; m<cells.n_i ; ++m){
+		alpha_destination[m] = a_tilde[m];
 	}
-	vector<double> delta_GX(nb_coef_no_K);
-	vector<double> delta2_X(nb_coef_no_K);
 
-	//
-	// Loop
-	//
+	cells_2_csc_mult(cells, csc_value_Ba.data(), alpha_origin.data(), beta.data());
 
-	NumericMatrix dxi_dbeta(n_obs, n_vars);
+	cells_2_csr_mult_add(cells, mat_value_Ab.data(), beta.data(), alpha_destination.data());
 
-	bool keepGoing = true;
-	int iter = 0, iter_all_max = 0;
+}
 
-	// We first loop on each variable
-	for(int v=0 ; v<n_vars ; ++v){
 
-		// loading the required data
-		double *my_deriv_init = pderiv_init[v];
-		double *my_jac = pjac[v];
+// 2 FEs: derivatives by tiles of variables (same principle as for deriv_acc_tile_gnl)
+// the cell matrices and sum_ll_d2 are shared by all the tiles
 
-		//
-		// we update the values of sum_jac_lld2
-		//
+struct PARAM_DERIV_TILE_2{
+	int n_obs;
+	int n_i;
+	int n_j;
 
-		for(int k=0 ; k<K ; ++k){
-			int *my_dum = pdum[k];
-			double *my_sum_jac_lld2 = psum_jac_lld2[k];
+	int *dum_i;
+	int *dum_j;
+	double *ll_d2;
+	double *sum_ll_d2_i;
+	double *sum_ll_d2_j;
+
+	// the cell matrices (CSR/CSC), the values of Ab in the CSR order and of Ba in the CSC order
+	double *mat_value_Ab;
+	CELLS_2 cells;
+	double *csc_value_Ba;
+
+	// variables
+	vector<double*> pjac;
+	vector<double*> pderiv_init;
+	double *pres; // dxi_dbeta, n_obs x n_vars
+	int n_vars;
+
+	// tiles
+	int S;
+
+	// algorithm
+	int iterMax;
+	double diffMax;
+	bool *stopnow;
+
+	// trace
+	int trace_every;
+	vector< vector<double> > *ptrace;
+	std::chrono::steady_clock::time_point time_start;
+};
 
-			for(int m=0 ; m<pcluster[k] ; ++m){
-				my_sum_jac_lld2[m] = 0;
-			}
+struct DERIV_TILE_2{
+	int S;
+	int n_active;
+
+	// by slot
+	vector<int> var;
+	vector<double*> pinit;
+	vector<double*> pderiv;
+	vector<double> IT_coef;
+	vector<int> iter_last_trace;
+
+	// interleaved, length n_i x S or n_j x S
+	vector<double> a;
+	vector<double> b;
+	vector<double> a_tilde;
+	vector<double> X;
+	vector<double> GX;
+	vector<double> GGX;
+	vector<double> beta; // workspace
+};
 
-			// sum the jac and deriv
-			for(int i=0 ; i<n_obs ; ++i){
-				my_sum_jac_lld2[my_dum[i]] += my_jac[i]*pll_d2[i];
-			}
+void swap_tile_slots_2(DERIV_TILE_2 &tile, int n_i, int n_j, int a, int b){
+	if(a == b) return;
+
+	std::swap(tile.var[a], tile.var[b]);
+	std::swap(tile.pinit[a], tile.pinit[b]);
+	std::swap(tile.pderiv[a], tile.pderiv[b]);
+	std::swap(tile.IT_coef[a], tile.IT_coef[b]);
+	std::swap(tile.iter_last_trace[a], tile.iter_last_trace[b]);
+
+	int S = tile.S;
+	swap_tile_values(tile.a, n_i, S, a, b);
+	swap_tile_values(tile.b, n_j, S, a, b);
+	swap_tile_values(tile.a_tilde, n_i, S, a, b);
+	swap_tile_values(tile.X, n_i, S, a, b);
+	swap_tile_values(tile.GX, n_i, S, a, b);
+	swap_tile_values(tile.GGX, n_i, S, a, b);
+}
+
+void computeDerivCoef_2_tile(const double *alpha_origin, double *alpha_destination,
+                             DERIV_TILE_2 &tile, PARAM_DERIV_TILE_2 *args){
+	// same as computeDerivCoef_2, on all the active columns of the tile
+	// a_tile + Ab * Ba * alpha
+
+	// the rows of the CSR/CSC being independent, they are processed in parallel
+	// (only when there is a single tile, see cpp_derivconv_acc_2)
+
+	int S = tile.S;
+	int n_active = tile.n_active;
+	const CELLS_2 &cells = args->cells;
+	double *mat_value_Ab = args->mat_value_Ab;
+	double *csc_value_Ba = args->csc_value_Ba;
+	double *beta = tile.beta.data();
+	const double *a_tilde = tile.a_tilde.data();
+
+	#pragma omp parallel for num_threads(cells.nthreads)
+	for(int j=0 ; j<cells.n_j ; ++j){
+		double *my_beta = beta + j*S;
+		for(int c=0 ; c<n_active ; ++c){
+			my_beta[c] = 0;
 		}
 
-		//
-		// The IT loop
-		//
+		for(int v=cells.col_start[j] ; v<cells.col_start[j + 1] ; ++v){
+			const double *my_alpha = alpha_origin + cells.csc_row[v]*S;
+			double value = csc_value_Ba[v];
+			for(int c=0 ; c<n_active ; ++c){
+				my_beta[c] += value * my_alpha[c];
+			}
+		}
+	}
 
-		// we initialize the deriv coefficients
-		for(int m=0 ; m<nb_coef ; ++m){
-			X[m] = 0;
+	#pragma omp parallel for num_threads(cells.nthreads)
+	for(int i=0 ; i<cells.n_i ; ++i){
+		double *my_alpha = alpha_destination + i*S;
+		for(int c=0 ; c<n_active ; ++c){
+			my_alpha[c] = a_tilde[i*S + c];
 		}
 
-		computeDerivCoef(pX, pGX, my_deriv_init, &args);
+		for(int u=cells.row_start[i] ; u<cells.row_start[i + 1] ; ++u){
+			const double *my_beta = beta + cells.mat_col[u]*S;
+			double value = mat_value_Ab[u];
+			for(int c=0 ; c<n_active ; ++c){
+				my_alpha[c] += value * my_beta[c];
+			}
+		}
+	}
+}
 
-		keepGoing = true;
-		iter = 0;
-		bool numconv = false;
+void deriv_tile_finish_2(int c, int iter, DERIV_TILE_2 &tile, PARAM_DERIV_TILE_2 *args,
+                         vector<double> &alpha_final, vector<double> &beta_final){
+	// the column in slot c has converged (or reached iterMax):
+	// we save its final deriv and it leaves the active slots
 
-		while(keepGoing && iter < iterMax){
-			++iter;
+	int n_i = args->n_i, n_j = args->n_j;
+	int S = tile.S;
 
-			// origin: GX, destination: GGX
-			computeDerivCoef(pGX, pGGX, my_deriv_init, &args);
+	if(args->trace_every > 0 && tile.iter_last_trace[c] != iter){
+		int v = tile.var[c];
+		trace_add((*args->ptrace)[v], args->time_start, v, iter, n_i,
+                  tile.X.data() + c, tile.GX.data() + c, tile.IT_coef[c], S);
+	}
 
-			// X ; update of the cluster coefficient
-			numconv = update_X_IronsTuck(nb_coef_no_K, X, GX, GGX, delta_GX, delta2_X);
-			if(numconv) break;
+	// we compute the last alpha and beta
+	for(int m=0 ; m<n_i ; ++m){
+		alpha_final[m] = tile.a[m*S + c];
+	}
 
-			// origin: X, destination: GX
-			computeDerivCoef(pX, pGX, my_deriv_init, &args);
+	for(int m=0 ; m<n_j ; ++m){
+		beta_final[m] = tile.b[m*S + c];
+	}
 
-			keepGoing = false;
-			// the stopping criterion
-			for(int m=0 ; m<nb_coef_no_K ; ++m){
-				// if(fabs(X[m] - GX[m]) / (0.1 + fabs(GX[m])) > diffMax){
-				if(continue_criterion(X[m], GX[m], diffMax)){
-				    // Rprintf("diffMax = %f\n", fabs(X[m] - GX[m]));
-					keepGoing = true;
-					break;
-				}
-			}
+	const CELLS_2 &cells = args->cells;
+	for(int j=0 ; j<n_j ; ++j){
+		for(int v=cells.col_start[j] ; v<cells.col_start[j + 1] ; ++v){
+			beta_final[j] += args->csc_value_Ba[v] * tile.GX[cells.csc_row[v]*S + c];
 		}
+	}
 
-		// save iteration info
-		if(iter > iter_all_max){
-			iter_all_max = iter;
+	for(int i=0 ; i<n_i ; ++i){
+		for(int u=cells.row_start[i] ; u<cells.row_start[i + 1] ; ++u){
+			alpha_final[i] += args->mat_value_Ab[u] * beta_final[cells.mat_col[u]];
 		}
+	}
 
-		//
-		// Save the deriv into res
-		//
+	// save
+	double *my_deriv = tile.pderiv[c];
+	double *my_init = tile.pinit[c];
+	int *dum_i = args->dum_i;
+	int *dum_j = args->dum_j;
+	for(int obs=0 ; obs<args->n_obs ; ++obs){
+		my_deriv[obs] = my_init[obs] + alpha_final[dum_i[obs]] + beta_final[dum_j[obs]];
+	}
 
-		// we compute the deriv based on the cluster coefs
-		for(int i=0 ; i<n_obs ; ++i){
-			deriv_with_coef[i] = my_deriv_init[i];
+	swap_tile_slots_2(tile, n_i, n_j, c, tile.n_active - 1);
+	tile.n_active--;
+}
+
+int deriv_acc_tile_2(int v_start, int n_cols, PARAM_DERIV_TILE_2 *args){
+	// solves the variables v_start to v_start + n_cols - 1
+	// returns the max number of iterations
+
+	int n_obs = args->n_obs;
+	int n_i = args->n_i, n_j = args->n_j;
+	int *dum_i = args->dum_i;
+	int *dum_j = args->dum_j;
+	double *pll_d2 = args->ll_d2;
+	bool isMaster = omp_get_thread_num() == 0;
+
+	DERIV_TILE_2 tile;
+	int S = n_cols;
+	tile.S = S;
+	tile.n_active = S;
+	tile.var.resize(S);
+	tile.pinit.resize(S);
+	tile.pderiv.resize(S);
+	tile.IT_coef.resize(S, NA_REAL);
+	tile.iter_last_trace.resize(S, -1);
+	tile.a.resize(n_i * S, 0);
+	tile.b.resize(n_j * S, 0);
+	tile.a_tilde.resize(n_i * S);
+	tile.X.resize(n_i * S, 0);
+	tile.GX.resize(n_i * S);
+	tile.GGX.resize(n_i * S);
+	tile.beta.resize(n_j * S);
+
+	vector<double> alpha_final(n_i);
+	vector<double> beta_final(n_j);
+
+	for(int c=0 ; c<S ; ++c){
+		int v = v_start + c;
+		tile.var[c] = v;
+		tile.pinit[c] = args->pderiv_init[v];
+		tile.pderiv[c] = args->pres + static_cast<long>(v) * n_obs;
+	}
+
+	//
+	// we compute the constants and then alpha tilde
+	//
+
+	double *a = tile.a.data(), *b = tile.b.data();
+	for(int obs=0 ; obs<n_obs ; ++obs){
+		double *my_a = a + dum_i[obs]*S;
+		double *my_b = b + dum_j[obs]*S;
+		for(int c=0 ; c<S ; ++c){
+			double value = (args->pjac[v_start + c][obs] + tile.pinit[c][obs]) * pll_d2[obs];
+			my_a[c] += value;
+			my_b[c] += value;
 		}
+	}
 
-		for(int k=0 ; k<K ; ++k){
-			int *my_dum = pdum[k];
-			double *my_deriv_coef = pGX[k];
-			for(int i=0 ; i<n_obs ; ++i){
-				deriv_with_coef[i] += my_deriv_coef[my_dum[i]];
-			}
+	for(int m=0 ; m<n_i ; ++m){
+		for(int c=0 ; c<S ; ++c){
+			a[m*S + c] /= -args->sum_ll_d2_i[m];
 		}
+	}
 
-		// save
-		for(int i=0 ; i<n_obs ; ++i){
-			dxi_dbeta(i, v) = deriv_with_coef[i];
+	for(int m=0 ; m<n_j ; ++m){
+		for(int c=0 ; c<S ; ++c){
+			b[m*S + c] /= -args->sum_ll_d2_j[m];
 		}
+	}
 
+	// a_tilde: a_tilde = a + (Ab %m% b)
+	double *a_tilde = tile.a_tilde.data();
+	for(int m=0 ; m<n_i*S ; ++m){
+		a_tilde[m] = a[m];
 	}
 
+	const CELLS_2 &cells = args->cells;
+	for(int i=0 ; i<n_i ; ++i){
+		double *my_a_tilde = a_tilde + i*S;
+		for(int u=cells.row_start[i] ; u<cells.row_start[i + 1] ; ++u){
+			double *my_b = b + cells.mat_col[u]*S;
+			double value = args->mat_value_Ab[u];
+			for(int c=0 ; c<S ; ++c){
+				my_a_tilde[c] += value * my_b[c];
+			}
+		}
+	}
 
-	List res;
-	res["dxi_dbeta"] = dxi_dbeta;
-	res["iter"] = iter_all_max;
+	//
+	// The IT loop
+	//
 
-	return(res);
-}
+	double *X = tile.X.data(), *GX = tile.GX.data(), *GGX = tile.GGX.data();
 
-void computeDerivCoef_2(vector<double> &alpha_origin, vector<double> &alpha_destination,
-                        int n_i, int n_j, int n_cells,
-                        const vector<double> &a_tilde,
-                        const vector<int> &mat_row, const vector<int> &mat_col,
-                        const vector<double> &mat_value_Ab, const vector<double> &mat_value_Ba,
-                        vector<double> &beta){
+	computeDerivCoef_2_tile(X, GX, tile, args);
 
-	// a_tile + Ab * Ba * alpha
+	int iter = 0;
+	while(tile.n_active > 0 && iter < args->iterMax){
 
-	for(int m=0 ; m<n_i ; ++m){
-		alpha_destination[m] = a_tilde[m];
-	}
+		if(isMaster && pending_interrupt()){
+			*(args->stopnow) = true;
+		}
+		if(*(args->stopnow)) break;
 
-	for(int m=0 ; m<n_j ; ++m){
-		beta[m] = 0;
-	}
+		++iter;
 
-	for(int obs=0 ; obs<n_cells ; ++obs){
-		beta[mat_col[obs]] += mat_value_Ba[obs] * alpha_origin[mat_row[obs]];
+		// origin: GX, destination: GGX
+		computeDerivCoef_2_tile(GX, GGX, tile, args);
+
+		// X ; update of the cluster coefficient
+		for(int c=tile.n_active - 1 ; c>=0 ; --c){
+			bool numconv = update_X_IronsTuck_tile(n_i, S, c, X, GX, GGX, tile.IT_coef[c]);
+			if(numconv){
+				deriv_tile_finish_2(c, iter, tile, args, alpha_final, beta_final);
+			}
+		}
+
+		if(tile.n_active == 0) break;
+
+		// origin: X, destination: GX
+		computeDerivCoef_2_tile(X, GX, tile, args);
+
+		// the stopping criterion
+		for(int c=tile.n_active - 1 ; c>=0 ; --c){
+			bool keepGoing = continue_criterion_tile(n_i, S, c, X, GX, args->diffMax);
+
+			if(args->trace_every > 0 && iter % args->trace_every == 0){
+				int v = tile.var[c];
+				trace_add((*args->ptrace)[v], args->time_start, v, iter, n_i, X + c, GX + c, tile.IT_coef[c], S);
+				tile.iter_last_trace[c] = iter;
+			}
+
+			if(!keepGoing){
+				deriv_tile_finish_2(c, iter, tile, args, alpha_final, beta_final);
+			}
+		}
 	}
 
-	for(int obs=0 ; obs<n_cells ; ++obs){
-		alpha_destination[mat_row[obs]] += mat_value_Ab[obs] * beta[mat_col[obs]];
+	// the columns which did not converge
+	for(int c=tile.n_active - 1 ; c>=0 ; --c){
+		deriv_tile_finish_2(c, iter, tile, args, alpha_final, beta_final);
 	}
 
+	return iter;
 }
 
+int deriv_run_tile_2(int t, int thread, void *_args){
+	PARAM_DERIV_TILE_2 *args = (PARAM_DERIV_TILE_2 *) _args;
+
+	int S = args->S;
+	int v_start = t*S;
+	int n_cols = args->n_vars - v_start < S ? args->n_vars - v_start : S;
+
+	return deriv_acc_tile_2(v_start, n_cols, args);
+}
 
 // [[Rcpp::export]]
 List cpp_derivconv_acc_2(int iterMax, double diffMax, int n_vars, SEXP nb_cluster_all,
                                   int n_cells, SEXP index_i, SEXP index_j, SEXP ll_d2, SEXP order,
-                                  SEXP jacob_vector, SEXP deriv_init_vector, SEXP dum_vector){
+                                  SEXP jacob_vector, SEXP deriv_init_vector, SEXP dum_vector,
+                                  int nthreads = 1, int trace_every = 0){
+
+	// The variables are solved by tiles, in parallel (see deriv_acc_tile_2)
+	// trace_every: if > 0, the convergence trace is saved every trace_every iterations
 
 	int n_obs = Rf_length(ll_d2);
 
@@ -2719,6 +4388,7 @@ List cpp_derivconv_acc_2(int iterMax, double diffMax, int n_vars, SEXP nb_cluste
 	vector<int> mat_col(n_cells);
 	vector<double> mat_value_Ab(n_cells);
 	vector<double> mat_value_Ba(n_cells);
+	vector<double> csc_value_Ba(n_cells);
 
 	int *pindex_i = INTEGER(index_i);
 	int *pindex_j = INTEGER(index_j);
@@ -2755,147 +4425,77 @@ List cpp_derivconv_acc_2(int iterMax, double diffMax, int n_vars, SEXP nb_cluste
 	mat_value_Ab[index_current] = value_Ab / -sum_ll_d2_i[pindex_i[n_obs-1]];;
 	mat_value_Ba[index_current] = value_Ba / -sum_ll_d2_j[pindex_j[n_obs-1]];;
 
-	//
-	// IT iteration (preparation)
-	//
-
-	vector<double> X(n_i);
-	vector<double> GX(n_i);
-	vector<double> GGX(n_i);
-	vector<double> delta_GX(n_i);
-	vector<double> delta2_X(n_i);
-	vector<double> beta(n_j);
-	vector<double> alpha_final(n_i);
-	vector<double> beta_final(n_j);
+	NumericMatrix dxi_dbeta(n_obs, n_vars);
 
 	//
-	// Loop
+	// Sending the information
 	//
 
-	NumericMatrix dxi_dbeta(n_obs, n_vars);
-
-	bool keepGoing = true;
-	int iter = 0, iter_all_max = 0;
-
-	// We first loop on each variable
-	for(int v=0 ; v<n_vars ; ++v){
-
-		// loading the required data
-		double *my_deriv_init = pderiv_init[v];
-		double *my_jac = pjac[v];
-
-		//
-		// we update the constants and then alpha tilde
-		//
-
-		// we compute the constants
-		vector<double> a(n_i);
-		vector<double> b(n_j);
-
-		for(int m=0 ; m<n_i ; ++m){
-			a[m] = 0;
-		}
-		for(int m=0 ; m<n_j ; ++m){
-			b[m] = 0;
-		}
-		for(int obs=0 ;obs<n_obs ; ++obs){
-			a[dum_i[obs]] += (my_jac[obs]+my_deriv_init[obs]) * pll_d2[obs];
-			b[dum_j[obs]] += (my_jac[obs]+my_deriv_init[obs]) * pll_d2[obs];
-		}
-		for(int m=0 ; m<n_i ; ++m){
-			a[m] /= -sum_ll_d2_i[m];
-		}
-		for(int m=0 ; m<n_j ; ++m){
-			b[m] /= -sum_ll_d2_j[m];
-		}
-
-
-		// a_tilde: a_tilde = a + (Ab %m% b)
-		vector<double> a_tilde(n_i);
-		for(int m=0 ; m<n_i ; ++m){
-			a_tilde[m] = a[m];
-		}
-		for(int i=0 ; i<n_cells ; ++i){
-			a_tilde[mat_row[i]] += mat_value_Ab[i] * b[mat_col[i]];
-		}
-
-		//
-		// The IT loop
-		//
-
-		// we initialize the deriv coefficients
-		for(int m=0 ; m<n_i ; ++m){
-			X[m] = 0;
-		}
-
-		computeDerivCoef_2(X, GX, n_i, n_j, n_cells, a_tilde, mat_row, mat_col, mat_value_Ab, mat_value_Ba, beta);
-
-		keepGoing = true;
-		iter = 0;
-		bool numconv = false;
-
-		while(keepGoing && iter < iterMax){
-			++iter;
-
-			// origin: GX, destination: GGX
-			computeDerivCoef_2(GX, GGX, n_i, n_j, n_cells, a_tilde, mat_row, mat_col, mat_value_Ab, mat_value_Ba, beta);
-
-			// X ; update of the cluster coefficient
-			numconv = update_X_IronsTuck(n_i, X, GX, GGX, delta_GX, delta2_X);
-			if(numconv) break;
-
-			// origin: X, destination: GX
-			computeDerivCoef_2(X, GX, n_i, n_j, n_cells, a_tilde, mat_row, mat_col, mat_value_Ab, mat_value_Ba, beta);
-
-			keepGoing = false;
-			// the stopping criterion
-			for(int m=0 ; m<n_i ; ++m){
-				// if(fabs(X[m] - GX[m]) / (0.1 + fabs(GX[m])) > diffMax){
-				if(continue_criterion(X[m], GX[m], diffMax)){
-					keepGoing = true;
-					break;
-				}
-			}
-		}
-
-		// save iteration info
-		if(iter > iter_all_max){
-			iter_all_max = iter;
-		}
+	bool stopnow = false;
+	vector< vector<double> > trace_all(n_vars);
 
-		//
-		// Save the deriv into res
-		//
+	PARAM_DERIV_TILE_2 args;
+	args.n_obs = n_obs;
+	args.n_i = n_i;
+	args.n_j = n_j;
+	args.dum_i = dum_i;
+	args.dum_j = dum_j;
+	args.ll_d2 = pll_d2;
+	args.sum_ll_d2_i = sum_ll_d2_i.data();
+	args.sum_ll_d2_j = sum_ll_d2_j.data();
+	args.mat_value_Ab = mat_value_Ab.data();
+	args.csc_value_Ba = csc_value_Ba.data();
+	args.pjac = pjac;
+	args.pderiv_init = pderiv_init;
+	args.pres = REAL(dxi_dbeta);
+	args.iterMax = iterMax;
+	args.diffMax = diffMax;
+	args.stopnow = &stopnow;
+	args.trace_every = trace_every;
+	args.ptrace = &trace_all;
+	args.time_start = std::chrono::steady_clock::now();
 
-		// we compute the last alpha and beta
-		for(int m=0 ; m<n_i ; ++m){
-			alpha_final[m] = a[m];
-		}
+	//
+	// Loop on the tiles
+	//
 
-		for(int m=0 ; m<n_j ; ++m){
-			beta_final[m] = b[m];
-		}
+	int S = deriv_tile_size(n_vars, nthreads);
+	int n_tiles = (n_vars + S - 1) / S;
+	vector<int> iter_tile(n_tiles, 0);
 
-		for(int obs=0 ; obs<n_cells ; ++obs){
-			beta_final[mat_col[obs]] += mat_value_Ba[obs] * GX[mat_row[obs]];
-		}
+	// CSR/CSC: with a single tile, the threads are used within the SpMVs
+	CELLS_2_STORE cells_store;
+	cells_2_setup(args.cells, cells_store, n_i, n_j, n_cells, mat_row.data(), mat_col.data(),
+               n_tiles == 1 ? nthreads : 1);
+	cells_2_to_csc(n_cells, cells_store.csc_cell.data(), mat_value_Ba.data(), csc_value_Ba.data());
 
-		for(int obs=0 ; obs<n_cells ; ++obs){
-			alpha_final[mat_row[obs]] += mat_value_Ab[obs] * beta_final[mat_col[obs]];
-		}
+	args.n_vars = n_vars;
+	args.S = S;
 
-		// save
-		for(int obs=0 ; obs<n_obs ; ++obs){
-			dxi_dbeta(obs, v) = my_deriv_init[obs] + alpha_final[dum_i[obs]] + beta_final[dum_j[obs]];
-		}
+	int nthreads_tiles = nthreads < n_tiles ? nthreads : n_tiles;
+	deriv_run_tiles(n_tiles, nthreads_tiles, &stopnow, iter_tile.data(), deriv_run_tile_2, &args);
 
+	if(stopnow){
+		stop("cpp_derivconv_acc_2: User interrupt.");
 	}
 
+	int iter_all_max = 0;
+	for(int t=0 ; t<n_tiles ; ++t){
+		if(iter_tile[t] > iter_all_max) iter_all_max = iter_tile[t];
+	}
 
 	List res;
 	res["dxi_dbeta"] = dxi_dbeta;
 	res["iter"] = iter_all_max;
 
+	if(trace_every > 0){
+		vector<double> trace;
+		for(int v=0 ; v<n_vars ; ++v){
+			trace.insert(trace.end(), trace_all[v].begin(), trace_all[v].end());
+		}
+		res["trace"] = trace_to_matrix(trace);
+	}
+
 	return(res);
 }
 
@@ -2903,7 +4503,8 @@ List cpp_derivconv_acc_2(int iterMax, double diffMax, int n_vars, SEXP nb_cluste
 // [[Rcpp::export]]
 List cpp_derivconv_seq_2(int iterMax, double diffMax, int n_vars, SEXP nb_cluster_all,
                                   int n_cells, SEXP index_i, SEXP index_j, SEXP order, SEXP ll_d2,
-                                  SEXP jacob_vector, SEXP deriv_init_vector, SEXP dum_vector){
+                                  SEXP jacob_vector, SEXP deriv_init_vector, SEXP dum_vector,
+                                  int nthreads = 1){
 
 	int n_obs = Rf_length(ll_d2);
 
@@ -2991,6 +4592,13 @@ List cpp_derivconv_seq_2(int iterMax, double diffMax, int n_vars, SEXP nb_cluste
 	mat_value_Ab[index_current] = value_current / -sum_ll_d2_i[pindex_i[n_obs-1]];
 	mat_value_Ba[index_current] = value_current / -sum_ll_d2_j[pindex_j[n_obs-1]];
 
+	// CSR/CSC storage
+	CELLS_2 cells;
+	CELLS_2_STORE cells_store;
+	cells_2_setup(cells, cells_store, n_i, n_j, n_cells, mat_row.data(), mat_col.data(), nthreads);
+	vector<double> csc_value_Ba(n_cells);
+	cells_2_to_csc(n_cells, cells_store.csc_cell.data(), mat_value_Ba.data(), csc_value_Ba.data());
+
 	//
 	// IT iteration (preparation)
 	//
@@ -3064,9 +4672,9 @@ List cpp_derivconv_seq_2(int iterMax, double diffMax, int n_vars, SEXP nb_cluste
 			++iter;
 
 			if(iter % 2 == 1){
-				computeDerivCoef_2(X, X_new, n_i, n_j, n_cells, a_tilde, mat_row, mat_col, mat_value_Ab, mat_value_Ba, beta);
+				computeDerivCoef_2(X, X_new, cells, a_tilde, mat_value_Ab, csc_value_Ba, beta);
 			} else {
-				computeDerivCoef_2(X_new, X, n_i, n_j, n_cells, a_tilde, mat_row, mat_col, mat_value_Ab, mat_value_Ba, beta);
+				computeDerivCoef_2(X_new, X, cells, a_tilde, mat_value_Ab, csc_value_Ba, beta);
 			}
 
 
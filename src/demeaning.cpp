@@ -27,16 +27,25 @@
  * I had to apply a trick to accomodate user interrupt in a parallel *
  * setup. It costs a bit, but it's clearly worth it.                 *
  *                                                                   *
+ * The IRLS of feglm is also here (cpp_irls): for the families      *
+ * implemented in C++, the whole loop (weights, demeaning, weighted  *
+ * OLS, step-halving) stays in C++.                                  *
+ *                                                                   *
+ * Finally, the detection of separation (Poisson) is at the end: it  *
+ * is a sequence of weighted demeanings + OLS (cpp_separation_relu). *
+ *                                                                   *
  ********************************************************************/
 
 #include <Rcpp.h>
 #include <math.h>
 #include <vector>
+#include <chrono>
 #ifdef _OPENMP
     #include <omp.h>
 #else
     #define omp_get_thread_num() 0
 #endif
+#include "glm_family.h"
 
 // [[Rcpp::plugins(openmp)]]
 
@@ -112,11 +121,48 @@ struct PARAM_DEMEAN{
 	// soptflag
 	bool *stopnow;
 	int *jobdone;
+
+	// convergence trace (one vector per variable)
+	int trace_every;
+	vector< vector<double> > *ptrace;
+	std::chrono::steady_clock::time_point time_start;
 };
 
+// Convergence trace:
+// Each row is: variable, phase, iter, max_diff, ssr, IT_coef, time
+// - phase: 0 => closed form (Q == 1), 1 => first acceleration, 2 => 2-FE convergence, 3 => re-acceleration
+// - max_diff: max absolute difference between X and G(X)
+// - time: in seconds, since the start of cpp_demean
+// Each variable is handled by a single thread => no need to protect the writes
+const int TRACE_NCOL = 7;
+
+void dm_trace_add(PARAM_DEMEAN *args, int v, int phase, int iter, double max_diff, double ssr, double IT_coef){
+
+	double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - args->time_start).count();
+
+	vector<double> &trace = (*(args->ptrace))[v];
+	trace.push_back(v + 1);
+	trace.push_back(phase);
+	trace.push_back(iter);
+	trace.push_back(max_diff);
+	trace.push_back(ssr);
+	trace.push_back(IT_coef);
+	trace.push_back(time);
+}
+
+double dm_max_diff(int n, const vector<double> &X, const vector<double> &GX){
+	double max_diff = 0;
+	for(int i=0 ; i<n ; ++i){
+		double diff = fabs(X[i] - GX[i]);
+		if(diff > max_diff) max_diff = diff;
+	}
+
+	return(max_diff);
+}
+
 bool dm_update_X_IronsTuck(int nb_coef_no_Q, vector<double> &X,
                         const vector<double> &GX, const vector<double> &GGX,
-                        vector<double> &delta_GX, vector<double> &delta2_X){
+                        vector<double> &delta_GX, vector<double> &delta2_X, double &IT_coef){
 
 	for(int i=0 ; i<nb_coef_no_Q ; ++i){
 	    double GX_tmp = GX[i];
@@ -135,8 +181,10 @@ bool dm_update_X_IronsTuck(int nb_coef_no_Q, vector<double> &X,
 
 	if(ssq == 0){
 		res = true;
+		IT_coef = 0;
 	} else {
 		double coef = vprod/ssq;
+		IT_coef = coef;
 
 		// update of X:
 		for(int i=0 ; i<nb_coef_no_Q ; ++i){
@@ -226,6 +274,114 @@ void demean_single_1(int v, PARAM_DEMEAN* args){
 	    }
 	}
 
+	// trace: closed form => single row
+	if(args->trace_every > 0){
+	    double ssr = 0, resid;
+	    for(int obs=0 ; obs<n_obs ; ++obs){
+	        resid = input[obs] - output[obs];
+	        ssr += resid*resid;
+	    }
+	    dm_trace_add(args, v, 0, 0, 0, ssr, NA_REAL);
+	}
+
+}
+
+void demean_single_1_threaded(int n_vars, int nthreads, PARAM_DEMEAN* args){
+	// Q == 1, all variables at once, parallelized over the observations
+	// Used when there are less variables than threads (demean_single_1 would leave threads idle)
+	// 1) each thread sums the variables over its own range of observations (a single pass on dum)
+	// 2) the partial sums are reduced in parallel over the clusters
+	// 3) the output is written in parallel over the observations
+	// the cluster sums are stored as [cluster x variable] so that all variables of an obs are contiguous
+
+	// loading the data
+	int n_obs = args->n_obs;
+	int nb_coef = args->nb_coef;
+	int *dum = args->pdum[0];
+	double *sum_weights = args->psum_weights[0];
+	vector<double*> &pinput = args->pinput;
+	vector<double*> &poutput = args->poutput;
+
+	bool isWeight = args->isWeight;
+	double *obs_weights = args->all_obs_weights[0];
+	bool isSlope = args->isSlope;
+	double *slope_var = args->all_slope_vars[0];
+
+	// thread-private sums: one block of size nb_coef*n_vars per thread
+	// (size_t: the total size can exceed the int range)
+	size_t n_coef_all = static_cast<size_t>(nb_coef) * n_vars;
+	vector<double> sum_all(n_coef_all * nthreads, 0);
+
+	#pragma omp parallel for num_threads(nthreads)
+	for(int t=0 ; t<nthreads ; ++t){
+		int start = (int)((double)t*n_obs/nthreads);
+		int stop = (int)((double)(t+1)*n_obs/nthreads);
+		double *my_sum = sum_all.data() + t*n_coef_all;
+
+		if(isWeight){
+			for(int obs=start ; obs<stop ; ++obs){
+				double *my_sum_obs = my_sum + dum[obs]*n_vars;
+				double w = obs_weights[obs];
+				for(int v=0 ; v<n_vars ; ++v){
+					my_sum_obs[v] += w * pinput[v][obs];
+				}
+			}
+		} else {
+			for(int obs=start ; obs<stop ; ++obs){
+				double *my_sum_obs = my_sum + dum[obs]*n_vars;
+				for(int v=0 ; v<n_vars ; ++v){
+					my_sum_obs[v] += pinput[v][obs];
+				}
+			}
+		}
+	}
+
+	// reduction => cluster coefs stored in the first block
+	double *cluster_coef = sum_all.data();
+
+	#pragma omp parallel for num_threads(nthreads)
+	for(int m=0 ; m<nb_coef ; ++m){
+		for(int v=0 ; v<n_vars ; ++v){
+			int index = m*n_vars + v;
+			double value = cluster_coef[index];
+			for(int t=1 ; t<nthreads ; ++t){
+				value += sum_all[t*n_coef_all + index];
+			}
+			cluster_coef[index] = value / sum_weights[m];
+		}
+	}
+
+	// Output:
+	#pragma omp parallel for num_threads(nthreads)
+	for(int obs=0 ; obs<n_obs ; ++obs){
+		double *my_coef = cluster_coef + dum[obs]*n_vars;
+		double slope = isSlope ? slope_var[obs] : 1;
+		for(int v=0 ; v<n_vars ; ++v){
+			poutput[v][obs] = slope * my_coef[v];
+		}
+	}
+
+	// saving the fixef coefs (only possible with a single variable)
+	if(args->save_fixef){
+		double *fixef_values = args->fixef_values;
+		for(int m=0 ; m<nb_coef ; ++m){
+			fixef_values[m] = cluster_coef[m];
+		}
+	}
+
+	// trace: closed form => single row per variable
+	if(args->trace_every > 0){
+		for(int v=0 ; v<n_vars ; ++v){
+			double *input = pinput[v];
+			double *output = poutput[v];
+			double ssr = 0, resid;
+			for(int obs=0 ; obs<n_obs ; ++obs){
+				resid = input[obs] - output[obs];
+				ssr += resid*resid;
+			}
+			dm_trace_add(args, v, 0, 0, 0, ssr, NA_REAL);
+		}
+	}
 
 }
 
@@ -288,6 +444,66 @@ void CCC_gaussian_2(const vector<double> &pcluster_origin, vector<double> &pclus
 
 }
 
+double dm_ssr_2(const vector<double> &alpha, const vector<double> &const_b, vector<double> &beta,
+                double *input, PARAM_DEMEAN *args){
+	// SSR of the input given the coefficients of the first FE (alpha)
+	// beta is used as a buffer and contains the coefficients of the second FE in the end
+
+	int n_obs = args->n_obs;
+	int n_j = args->pcluster[1];
+
+	bool isWeight = args->isWeight;
+	double *obs_weights_j = args->all_obs_weights[1];
+	double *sum_weights_j = args->psum_weights[1];
+
+	bool isSlope = args->isSlope;
+	bool isSlope_i = args->slope_flag[0];
+	double *slope_var_i = args->all_slope_vars[0];
+	double *slope_var_j = args->all_slope_vars[1];
+
+	int *dum_i = args->pdum[0];
+	int *dum_j = args->pdum[1];
+
+	// we need to compute beta
+	for(int j=0 ; j<n_j ; ++j){
+		beta[j] = 0;
+	}
+
+	if(isSlope_i){
+	    for(int obs=0 ; obs<n_obs ; ++obs){
+	        beta[dum_j[obs]] -= obs_weights_j[obs] * slope_var_i[obs] * alpha[dum_i[obs]];
+	    }
+	} else if(isWeight){
+		for(int obs=0 ; obs<n_obs ; ++obs){
+			beta[dum_j[obs]] -= obs_weights_j[obs] * alpha[dum_i[obs]];
+		}
+	} else {
+		for(int obs=0 ; obs<n_obs ; ++obs){
+			beta[dum_j[obs]] -= alpha[dum_i[obs]];
+		}
+	}
+
+	for(int j=0 ; j<n_j ; ++j){
+		beta[j] /= sum_weights_j[j];
+		beta[j] += const_b[j];
+	}
+
+	double ssr = 0, resid;
+	if(isSlope){
+	    for(int obs=0 ; obs<n_obs ; ++obs){
+	        resid = input[obs] - (slope_var_i[obs] * alpha[dum_i[obs]] + slope_var_j[obs] * beta[dum_j[obs]]);
+	        ssr += resid*resid;
+	    }
+	} else {
+	    for(int obs=0 ; obs<n_obs ; ++obs){
+	        resid = input[obs] - (alpha[dum_i[obs]] + beta[dum_j[obs]]);
+	        ssr += resid*resid;
+	    }
+	}
+
+	return(ssr);
+}
+
 void demean_acc_2(int v, int iterMax, PARAM_DEMEAN *args){
 
 	//
@@ -423,6 +639,11 @@ void demean_acc_2(int v, int iterMax, PARAM_DEMEAN *args){
 	// double input_mean = 0;
 	double ssr = 0;
 
+	// trace
+	int trace_every = args->trace_every;
+	int iter_last_trace = -1;
+	double IT_coef = NA_REAL;
+
 	bool numconv = false;
 	bool keepGoing = true;
 	int iter = 1;
@@ -443,7 +664,7 @@ void demean_acc_2(int v, int iterMax, PARAM_DEMEAN *args){
                  sum_weights_i, sum_weights_j, a_tilde, beta);
 
 		// X ; update of the cluster coefficient
-		numconv = dm_update_X_IronsTuck(n_i, X, GX, GGX, delta_GX, delta2_X);
+		numconv = dm_update_X_IronsTuck(n_i, X, GX, GGX, delta_GX, delta2_X, IT_coef);
 		if(numconv) break;
 
 		// GX -- origin: X, destination: GX
@@ -460,92 +681,23 @@ void demean_acc_2(int v, int iterMax, PARAM_DEMEAN *args){
 			}
 		}
 
+		// trace
+		if(trace_every > 0 && iter % trace_every == 0){
+			dm_trace_add(args, v, 2, iter, dm_max_diff(n_i, X, GX), dm_ssr_2(GX, const_b, beta, input, args), IT_coef);
+			iter_last_trace = iter;
+		}
+
 		// Other stopping criterion: change to SSR very small
 		if(iter % 50 == 0){
 
-			// we need to compute beta
-			for(int j=0 ; j<n_j ; ++j){
-				beta[j] = 0;
-			}
-
-			if(isSlope_i){
-			    for(int obs=0 ; obs<n_obs ; ++obs){
-			        beta[dum_j[obs]] -= obs_weights_j[obs] * slope_var_i[obs] * GX[dum_i[obs]];
-			    }
-			} else if(isWeight){
-				for(int obs=0 ; obs<n_obs ; ++obs){
-					beta[dum_j[obs]] -= obs_weights_j[obs] * GX[dum_i[obs]];
-				}
-			} else {
-				for(int obs=0 ; obs<n_obs ; ++obs){
-					beta[dum_j[obs]] -= GX[dum_i[obs]];
-				}
-			}
-
-			for(int j=0 ; j<n_j ; ++j){
-				beta[j] /= sum_weights_j[j];
-				beta[j] += const_b[j];
-			}
-
-			vector<double> mu_current(n_obs);
-			if(isSlope){
-			    for(int obs=0 ; obs<n_obs ; ++obs){
-			        mu_current[obs] = slope_var_i[obs] * GX[dum_i[obs]] + slope_var_j[obs] * beta[dum_j[obs]];
-			    }
-			} else {
-			    for(int obs=0 ; obs<n_obs ; ++obs){
-			        mu_current[obs] = GX[dum_i[obs]] + beta[dum_j[obs]];
-			    }
-			}
-
-
 			// init ssr if iter == 50 / otherwise, comparison
 			if(iter == 50){
-				// for(int i=0 ; i<n_obs ; ++i){
-				// 	mu_last[i] = mu_current[i];
-				// }
-				//
-				// for(int i=0 ; i<n_obs ; ++i){
-				// 	input_mean += input[i];
-				// }
-				// input_mean /= n_obs;
-				// input_mean = fabs(input_mean);
-
-				ssr = 0;
-			    double resid;
-			    for(int i=0 ; i<n_obs ; ++i){
-			        resid = input[i] - mu_current[i];
-			        ssr += resid*resid;
-			    }
-
+				ssr = dm_ssr_2(GX, const_b, beta, input, args);
 			} else {
-				// double mu_diff = 0;
-				// for(int i=0 ; i<n_obs ; ++i){
-				// 	mu_diff += fabs(mu_last[i] - mu_current[i]);
-				// }
-				// mu_diff = mu_diff / n_obs; // we scale it to have a meaningful value
-				// // Rprintf("iter %i -- mu_diff = %f (mean = %f)\n", iter, mu_diff, input_mean);
-				//
-				// // if(mu_diff < diffMax || mu_diff / (0.1 + input_mean) < diffMax){
-				// if(stopping_crit(input_mean, mu_diff + input_mean, diffMax)){
-				// 	// Rprintf("mu_diff BREAK\n");
-				// 	break;
-				// }
-				//
-				// // we update mu_last
-				// for(int i=0 ; i<n_obs ; ++i){
-				// 	mu_last[i] = mu_current[i];
-				// }
-
 				double ssr_old = ssr;
 
 			    // we compute the new SSR
-			    ssr = 0;
-			    double resid;
-			    for(int i=0 ; i<n_obs ; ++i){
-			        resid = input[i] - mu_current[i];
-			        ssr += resid*resid;
-			    }
+			    ssr = dm_ssr_2(GX, const_b, beta, input, args);
 
 			    // if(isMaster) Rprintf("iter %i -- SSR = %.0f (diff = %.0f)\n", iter, ssr, ssr_old - ssr);
 
@@ -558,6 +710,10 @@ void demean_acc_2(int v, int iterMax, PARAM_DEMEAN *args){
 
 	}
 
+	if(trace_every > 0 && iter_last_trace != iter){
+		dm_trace_add(args, v, 2, iter, dm_max_diff(n_i, X, GX), dm_ssr_2(GX, const_b, beta, input, args), IT_coef);
+	}
+
 	//
 	// we update the result (output)
 	//
@@ -775,7 +931,44 @@ void computeMeans(vector<double*> &pcluster_origin, vector<double*> &pcluster_de
 
 }
 
-bool demean_acc_gnl(int v, int iterMax, PARAM_DEMEAN *args){
+double dm_ssr_gnl(vector<double*> &pcluster_coef, double *input, PARAM_DEMEAN *args){
+	// SSR of the input given the current FE coefficients
+
+	int n_obs = args->n_obs;
+	int Q = args->Q;
+	vector<int*> &pdum = args->pdum;
+	int *slope_flag = args->slope_flag;
+	vector<double*> &all_slope_vars = args->all_slope_vars;
+
+    // mu_current is the vector of means
+	vector<double> mu_current(n_obs, 0);
+	for(int q=0 ; q<Q ; ++q){
+		int *my_dum = pdum[q];
+		double *my_cluster_coef = pcluster_coef[q];
+
+		if(slope_flag[q]){
+		    double *my_slope_var = all_slope_vars[q];
+		    for(int obs=0 ; obs<n_obs ; ++obs){
+		        mu_current[obs] += my_slope_var[obs] * my_cluster_coef[my_dum[obs]];
+		    }
+		} else {
+		    for(int obs=0 ; obs<n_obs ; ++obs){
+		        mu_current[obs] += my_cluster_coef[my_dum[obs]];
+		    }
+		}
+
+	}
+
+	double ssr = 0, resid;
+	for(int i=0 ; i<n_obs ; ++i){
+	    resid = input[i] - mu_current[i];
+	    ssr += resid*resid;
+	}
+
+	return(ssr);
+}
+
+bool demean_acc_gnl(int v, int iterMax, PARAM_DEMEAN *args, int phase){
 
 	//
 	// data
@@ -891,6 +1084,11 @@ bool demean_acc_gnl(int v, int iterMax, PARAM_DEMEAN *args){
 	// double input_mean = 0;
 	double ssr = 0;
 
+	// trace
+	int trace_every = args->trace_every;
+	int iter_last_trace = -1;
+	double IT_coef = NA_REAL;
+
 	int iter = 0;
 	bool numconv = false;
 	while(!*pStopNow && keepGoing && iter<iterMax){
@@ -908,7 +1106,7 @@ bool demean_acc_gnl(int v, int iterMax, PARAM_DEMEAN *args){
 		computeMeans(pGX, pGGX, sum_other_means, psum_input_output, args);
 
 		// X ; update of the cluster coefficient
-		numconv = dm_update_X_IronsTuck(nb_coef_no_Q, X, GX, GGX, delta_GX, delta2_X);
+		numconv = dm_update_X_IronsTuck(nb_coef_no_Q, X, GX, GGX, delta_GX, delta2_X, IT_coef);
 		if(numconv) break;
 
 		// GX -- origin: X, destination: GX
@@ -924,74 +1122,23 @@ bool demean_acc_gnl(int v, int iterMax, PARAM_DEMEAN *args){
 			}
 		}
 
+		// trace
+		if(trace_every > 0 && iter % trace_every == 0){
+			dm_trace_add(args, v, phase, iter, dm_max_diff(nb_coef_no_Q, X, GX), dm_ssr_gnl(pGX, input, args), IT_coef);
+			iter_last_trace = iter;
+		}
+
 		// Other stopping criterion: change to SSR very small
 		if(iter % 50 == 0){
 
-		    // mu_current is the vector of means
-			vector<double> mu_current(n_obs, 0);
-			for(int q=0 ; q<Q ; ++q){
-				int *my_dum = pdum[q];
-				double *my_cluster_coef = pGX[q];
-
-				if(slope_flag[q]){
-				    double *my_slope_var = all_slope_vars[q];
-				    for(int obs=0 ; obs<n_obs ; ++obs){
-				        mu_current[obs] += my_slope_var[obs] * my_cluster_coef[my_dum[obs]];
-				    }
-				} else {
-				    for(int obs=0 ; obs<n_obs ; ++obs){
-				        mu_current[obs] += my_cluster_coef[my_dum[obs]];
-				    }
-				}
-
-			}
-
 			// init ssr if iter == 50 / otherwise, comparison
 			if(iter == 50){
-				// for(int i=0 ; i<n_obs ; ++i){
-				// 	mu_last[i] = mu_current[i];
-				// }
-
-				// for(int i=0 ; i<n_obs ; ++i){
-				// 	input_mean += input[i];
-				// }
-				// input_mean /= n_obs;
-				// input_mean = fabs(input_mean);
-
-				ssr = 0;
-			    double resid;
-			    for(int i=0 ; i<n_obs ; ++i){
-			        resid = input[i] - mu_current[i];
-			        ssr += resid*resid;
-    	        }
-
+				ssr = dm_ssr_gnl(pGX, input, args);
 			} else {
-				// double mu_diff = 0;
-				// for(int i=0 ; i<n_obs ; ++i){
-				// 	mu_diff += fabs(mu_last[i] - mu_current[i]);
-				// }
-				// mu_diff = mu_diff / n_obs; // we scale it to have a meaningful value
-				// // Rprintf("iter %i -- mu_diff = %f (mean = %f)\n", iter, mu_diff, input_mean);
-				//
-				// // if(mu_diff / (0.1 + input_mean) < diffMax){
-				// if(stopping_crit(input_mean, mu_diff + input_mean, diffMax)){
-				// 	// Rprintf("mu_diff BREAK\n");
-				// 	break;
-				// }
-				//
-				// // we update mu_last
-				// for(int i=0 ; i<n_obs ; ++i){
-				// 	mu_last[i] = mu_current[i];
-				// }
 				double ssr_old = ssr;
 
 			    // we compute the new SSR
-			    ssr = 0;
-			    double resid;
-			    for(int i=0 ; i<n_obs ; ++i){
-			        resid = input[i] - mu_current[i];
-			        ssr += resid*resid;
-			    }
+			    ssr = dm_ssr_gnl(pGX, input, args);
 
 			    // if(isMaster) Rprintf("iter %i -- SSR = %.0f (diff = %.0f)\n", iter, ssr, ssr_old - ssr);
 
@@ -1005,6 +1152,10 @@ bool demean_acc_gnl(int v, int iterMax, PARAM_DEMEAN *args){
 
 	}
 
+	if(trace_every > 0 && iter_last_trace != iter){
+		dm_trace_add(args, v, phase, iter, dm_max_diff(nb_coef_no_Q, X, GX), dm_ssr_gnl(pGX, input, args), IT_coef);
+	}
+
 	//
 	// Updating the output
 	//
@@ -1056,10 +1207,10 @@ void demean_single_gnl(int v, PARAM_DEMEAN* args){
 
 	if(Q == 2){
 		demean_acc_2(v, iterMax, args);
-		// demean_acc_gnl(v, iterMax, args);
+		// demean_acc_gnl(v, iterMax, args, 1);
 	} else {
 		// 15 iterations
-		bool conv = demean_acc_gnl(v, 15, args);
+		bool conv = demean_acc_gnl(v, 15, args, 1);
 
 		if(conv == false){
 			// 2 convergence
@@ -1067,7 +1218,7 @@ void demean_single_gnl(int v, PARAM_DEMEAN* args){
 
 			if(Q > 2){
 				// re-acceleration
-				demean_acc_gnl(v, iterMax / 2, args);
+				demean_acc_gnl(v, iterMax / 2, args, 3);
 			}
 		}
 	}
@@ -1109,56 +1260,62 @@ void stayIdleCheckingInterrupt(bool *stopnow, vector<int> &jobdone, int n_vars,
 
 }
 
-// Loop over demean_single
-// [[Rcpp::export]]
-List cpp_demean(SEXP y, SEXP X_raw, SEXP r_weights, int iterMax, double diffMax, SEXP nb_cluster_all,
-                SEXP dum_vector, SEXP tableCluster_vector, SEXP slope_flag, SEXP slope_vars,
-                SEXP r_init, int checkWeight, int nthreads, bool save_fixef = false){
-	// main fun that calls demean_single
-	// preformat all the information needed on the clusters
-	// y: the dependent variable
-	// X_raw: the matrix of the explanatory variables -- can be "empty"
+//
+// Setup of the FEs and the weights
+//
 
-	// when including weights: recreate table values
-	// export weights and isWeight bool
+// All the information on the FEs and the weights required by the demeaning
+// Set up once with dm_fe_setup, the weights can then be changed with dm_fe_set_weights
+// without any reallocation (the IRLS changes the weights at each iteration)
+struct DEMEAN_FE{
+	int n_obs;
+	int Q;
+	int nb_coef;
+	int *pcluster;
+	int *table_vector;
 
-	// slope_flag: whether a FE is a varying slope
-	// slope_var: the associated variables with varying slopes
+	// cluster id for each observation
+	vector<int*> pdum;
+
+	// slopes
+	bool isSlope;
+	int *pslope_flag;
+	vector<double*> all_slope_vars;
+	vector<double> neutral_var;
+
+	// weights: set by dm_fe_set_weights
+	bool isWeight;
+	vector<double> sum_weights;
+	vector<double*> psum_weights;
+	// all_obs_weights: weights for each FE (I created it to take care of slopes)
+	vector<double*> all_obs_weights;
+	// slope_weights_vector will contain obs_weight[obs]*vars[obs] for slopes, and obs_weight[obs]
+	//    for non slopes [thus we initialize at 1 -- default if no weights no slope]
+	vector<double> slope_weights_vector;
+};
+
+void dm_fe_setup(DEMEAN_FE &fe, int n_obs, SEXP nb_cluster_all, SEXP dum_vector,
+                 SEXP tableCluster_vector, SEXP slope_flag, SEXP slope_vars){
 
-	//initial variables
 	int Q = Rf_length(nb_cluster_all);
 	int *pcluster = INTEGER(nb_cluster_all);
-	int n_obs = Rf_length(y);
-	bool isWeight = Rf_length(r_weights) != 1;
-
-	// whether we use X_raw
-	int n_X = Rf_length(X_raw);
-	int n_vars;
-	bool useX;
-	if(n_X == 1){
-		// means X_raw not needed
-		n_vars = 1; // only y
-		useX = false;
-	} else {
-		n_vars = n_X / n_obs + 1;
-		useX = true;
-	}
 
-	// initialisation if needed
-	bool isInit = Rf_length(r_init) != 1;
-	double *init = REAL(r_init);
-	bool saveInit = isInit || init[0] != 0;
+	fe.n_obs = n_obs;
+	fe.Q = Q;
+	fe.pcluster = pcluster;
+	fe.table_vector = INTEGER(tableCluster_vector);
 
 	int nb_coef = 0;
 	for(int q=0 ; q<Q ; ++q){
 		nb_coef += pcluster[q];
 	}
+	fe.nb_coef = nb_coef;
 
 	// cluster id for each observation
-	vector<int*> pdum(Q);
-	pdum[0] = INTEGER(dum_vector);
+	fe.pdum.resize(Q);
+	fe.pdum[0] = INTEGER(dum_vector);
 	for(int q=1 ; q<Q ; ++q){
-		pdum[q] = pdum[q - 1] + n_obs;
+		fe.pdum[q] = fe.pdum[q - 1] + n_obs;
 	}
 
 	// Handling slopes
@@ -1168,43 +1325,56 @@ List cpp_demean(SEXP y, SEXP X_raw, SEXP r_weights, int iterMax, double diffMax,
         nb_slopes += pslope_flag[q];
 	}
 	bool isSlope = nb_slopes > 0;
-	vector<double*> all_slope_vars(Q);
-	vector<double> neutral_var(isSlope ? n_obs : 1, 1);
+	fe.isSlope = isSlope;
+	fe.pslope_flag = pslope_flag;
+	fe.all_slope_vars.resize(Q);
+	fe.neutral_var.assign(isSlope ? n_obs : 1, 1);
 
     // we initialize all_slope_vars to the values of slope_vars
     // to neutral_var if not slope
     int index = 0;
     for(int q=0 ; q<Q ; ++q){
         if(pslope_flag[q]){
-            all_slope_vars[q] = REAL(slope_vars) + index;
+            fe.all_slope_vars[q] = REAL(slope_vars) + index;
             index += n_obs;
         } else {
-            all_slope_vars[q] = neutral_var.data();
+            fe.all_slope_vars[q] = fe.neutral_var.data();
         }
     }
 
-	// Handling weights
-	// if there are weights: sum_weights
-	vector<double> sum_weights(nb_coef, 0);
-	vector<double*> psum_weights(Q);
-	psum_weights[0] = sum_weights.data();
+	// weights
+	fe.sum_weights.resize(nb_coef);
+	fe.psum_weights.resize(Q);
+	fe.psum_weights[0] = fe.sum_weights.data();
 	for(int q=1 ; q<Q ; ++q){
-		psum_weights[q] = psum_weights[q - 1] + pcluster[q - 1];
+		fe.psum_weights[q] = fe.psum_weights[q - 1] + pcluster[q - 1];
 	}
 
-	double *obs_weights = REAL(r_weights);
-	// all_obs_weights: weights for each FE (I created it to take care of slopes)
-	vector<double*> all_obs_weights(Q);
-	int *table_vector = INTEGER(tableCluster_vector);
+	fe.all_obs_weights.resize(Q);
+	fe.slope_weights_vector.assign(isSlope ? Q * n_obs : 1, 1);
+}
 
-	// slope_weights_vector will contain obs_weight[obs]*vars[obs] for slopes, and obs_weight[obs]
-	//    for non slopes [thus we initialize at 1 -- default if no weights no slope]
-	vector<double> slope_weights_vector(isSlope ? Q * n_obs : 1, 1);
+void dm_fe_set_weights(DEMEAN_FE &fe, double *obs_weights, bool isWeight, bool checkWeight){
+	// obs_weights: must be valid as long as fe is used (not copied)
 
-	if(isSlope){
+	int n_obs = fe.n_obs;
+	int Q = fe.Q;
+	int nb_coef = fe.nb_coef;
+	vector<int*> &pdum = fe.pdum;
+	vector<double*> &psum_weights = fe.psum_weights;
+	vector<double*> &all_obs_weights = fe.all_obs_weights;
+	int *pslope_flag = fe.pslope_flag;
+
+	// if there are weights: sum_weights
+	vector<double> &sum_weights = fe.sum_weights;
+	for(int i=0 ; i<nb_coef ; ++i){
+		sum_weights[i] = 0;
+	}
+
+	if(fe.isSlope){
 
 	    // all_obs_weights refer to the values in slope_weights_vector
-	    all_obs_weights[0] = slope_weights_vector.data();
+	    all_obs_weights[0] = fe.slope_weights_vector.data();
 	    for(int q=1 ; q<Q ; ++q){
 	        all_obs_weights[q] = all_obs_weights[q - 1] + n_obs;
 	    }
@@ -1217,7 +1387,7 @@ List cpp_demean(SEXP y, SEXP X_raw, SEXP r_weights, int iterMax, double diffMax,
 	        double *my_slope_weights = all_obs_weights[q];
 
 	        if(pslope_flag[q]){
-	            double *my_slope_var = all_slope_vars[q];
+	            double *my_slope_var = fe.all_slope_vars[q];
 	            if(isWeight){
 	                for(int obs=0 ; obs<n_obs ; ++obs){
 	                    double var = my_slope_var[obs];
@@ -1242,6 +1412,7 @@ List cpp_demean(SEXP y, SEXP X_raw, SEXP r_weights, int iterMax, double diffMax,
 	                }
 	            } else {
 	                for(int obs=0 ; obs<n_obs ; ++obs){
+	                    my_slope_weights[obs] = 1;
 	                    my_SW[my_dum[obs]]++;
 	                }
 	            }
@@ -1253,7 +1424,7 @@ List cpp_demean(SEXP y, SEXP X_raw, SEXP r_weights, int iterMax, double diffMax,
 
 	    // this is always the same weights
 	    for(int q=0 ; q<Q ; ++q){
-	        all_obs_weights[q] = REAL(r_weights);
+	        all_obs_weights[q] = obs_weights;
 	    }
 
 	    if(isWeight){
@@ -1267,70 +1438,50 @@ List cpp_demean(SEXP y, SEXP X_raw, SEXP r_weights, int iterMax, double diffMax,
 	    } else {
 	        // we pass the value of table_vector to sum_weights
 	        for(int i=0 ; i<nb_coef ; ++i){
-	            sum_weights[i] = table_vector[i];
+	            sum_weights[i] = fe.table_vector[i];
 	        }
 	    }
 	}
 
 	// We update the weight information => slope is (almost) like using weights
-	isWeight = isWeight || isSlope;
+	fe.isWeight = isWeight || fe.isSlope;
 
 	// We avoid 0 weight clusters => (otherwise division by 0 leads to NA)
-	if(checkWeight || isSlope){
+	if(checkWeight || fe.isSlope){
 		for(int coef=0 ; coef<nb_coef ; ++coef){
 			if(sum_weights[coef] == 0){
 				sum_weights[coef] = 1;
 			}
 		}
 	}
+}
 
-	// we put all input variables into a single vector
-	// the dep var is the last one
-	vector<double> input_values(n_obs*n_vars);
+// Demeans the n_vars variables stacked in input_values (the variables are not modified)
+// output_values: in => starting values of the means, out => the means
+// iterations: length n_vars
+// returns false if the user interrupted the algorithm
+bool dm_run(DEMEAN_FE &fe, int n_vars, double *input_values, double *output_values,
+            int iterMax, double diffMax, int nthreads, int *iterations,
+            bool save_fixef, double *fixef_values,
+            int trace_every, vector< vector<double> > &trace_all){
 
-	if(useX){
-		double* pX_raw = REAL(X_raw);
-		for(int i = 0 ; i < (n_obs*(n_vars - 1)) ; ++i){
-			input_values[i] = pX_raw[i];
-		}
-	}
+	int n_obs = fe.n_obs;
+	int Q = fe.Q;
+	int nb_coef = fe.nb_coef;
 
-	double* py = REAL(y);
-	int y_start = n_obs*(n_vars - 1);
-	for(int i = 0 ; i < n_obs ; ++i){
-		input_values[y_start + i] = py[i];
+	// vector of pointers: input/output
+	vector<double*> pinput(n_vars);
+	vector<double*> poutput(n_vars);
+	pinput[0] = input_values;
+	poutput[0] = output_values;
+	for(int v=1 ; v<n_vars ; v++){
+		pinput[v] = pinput[v - 1] + n_obs;
+		poutput[v] = poutput[v - 1] + n_obs;
 	}
 
-	// output vector:
-	vector<double> output_values(n_obs*n_vars, 0);
-
-	if(isInit){
-		for(int i=0 ; i<(n_obs*n_vars) ; ++i){
-			output_values[i] = init[i];
-		}
-	}
-
-	// vector of pointers: input/output
-	vector<double*> pinput(n_vars);
-	vector<double*> poutput(n_vars);
-	pinput[0] = input_values.data();
-	poutput[0] = output_values.data();
-	for(int v=1 ; v<n_vars ; v++){
-		pinput[v] = pinput[v - 1] + n_obs;
-		poutput[v] = poutput[v - 1] + n_obs;
-	}
-
-	// keeping track of iterations
-	vector<int> iterations_all(n_vars, 0);
-	int *piterations_all = iterations_all.data();
-
-	// save fixef option
-	if(useX && save_fixef){
-	    stop("save_fixef can be used only when there is no Xs.");
-	}
-
-	vector<double> fixef_values(save_fixef ? nb_coef : 1, 0);
-	double *pfixef_values = fixef_values.data();
+	for(int v=0 ; v<n_vars ; ++v){
+		iterations[v] = 0;
+	}
 
 	//
 	// Sending variables to envir
@@ -1343,23 +1494,23 @@ List cpp_demean(SEXP y, SEXP X_raw, SEXP r_weights, int iterMax, double diffMax,
 	args.diffMax = diffMax;
 	args.Q = Q;
 	args.nb_coef = nb_coef;
-	args.pdum = pdum;
-	args.pcluster = pcluster;
+	args.pdum = fe.pdum;
+	args.pcluster = fe.pcluster;
 	args.pinput = pinput;
 	args.poutput = poutput;
-	args.piterations_all = piterations_all;
+	args.piterations_all = iterations;
 
 	// weights + slope:
-	args.isWeight = isWeight;
-	args.psum_weights = psum_weights;
-	args.all_obs_weights = all_obs_weights;
-	args.all_slope_vars = all_slope_vars;
-	args.slope_flag = pslope_flag;
-	args.isSlope = isSlope;
+	args.isWeight = fe.isWeight;
+	args.psum_weights = fe.psum_weights;
+	args.all_obs_weights = fe.all_obs_weights;
+	args.all_slope_vars = fe.all_slope_vars;
+	args.slope_flag = fe.pslope_flag;
+	args.isSlope = fe.isSlope;
 
 	// save fixef:
 	args.save_fixef = save_fixef;
-	args.fixef_values = pfixef_values;
+	args.fixef_values = fixef_values;
 
 	// stopping flag + indicator that job is finished
 	bool stopnow = false;
@@ -1371,37 +1522,168 @@ List cpp_demean(SEXP y, SEXP X_raw, SEXP r_weights, int iterMax, double diffMax,
 	int counter = 0;
 	int *pcounter = &counter;
 
+	// convergence trace
+	trace_all.assign(n_vars, vector<double>());
+	args.trace_every = trace_every;
+	args.ptrace = &trace_all;
+	args.time_start = std::chrono::steady_clock::now();
+
 
 	//
 	// the main loop
 	//
 
-	// enlever les rprintf dans les nthreads jobs
+	// Q == 1 with less variables than threads: we parallelize over the observations instead
+	// the thread-private cluster sums must remain small wrt the data
+	bool is_1_threaded = Q == 1 && nthreads > 1 && n_vars < nthreads && (double)nb_coef * nthreads <= n_obs;
+
+	if(is_1_threaded){
+		demean_single_1_threaded(n_vars, nthreads, &args);
+	} else {
+
+		// enlever les rprintf dans les nthreads jobs
 #pragma omp parallel for num_threads(nthreads) schedule(static, 1)
-	for(int v = 0 ; v<(n_vars+nthreads) ; ++v){
-		// demean_single is the workhorse
-		// you get the "mean"
-
-		if(!*(args.stopnow)){
-			if(v < n_vars){
-				if(Q == 1){
-					demean_single_1(v, &args);
-				} else {
-					demean_single_gnl(v, &args);
+		for(int v = 0 ; v<(n_vars+nthreads) ; ++v){
+			// demean_single is the workhorse
+			// you get the "mean"
+
+			if(!*(args.stopnow)){
+				if(v < n_vars){
+					if(Q == 1){
+						demean_single_1(v, &args);
+					} else {
+						demean_single_gnl(v, &args);
+					}
+				} else if(true && Q != 1){
+					stayIdleCheckingInterrupt(&stopnow, jobdone, n_vars, pcounter);
 				}
-			} else if(true && Q != 1){
-				stayIdleCheckingInterrupt(&stopnow, jobdone, n_vars, pcounter);
 			}
+
 		}
+	}
 
+	// Rprintf("Master checking: %i\n", *pcounter);
+
+	return !stopnow;
+}
+
+NumericMatrix dm_trace_to_matrix(const vector< vector<double> > &trace_all){
+
+	int n_vars = trace_all.size();
+	int n_rows = 0;
+	for(int v=0 ; v<n_vars ; ++v){
+		n_rows += trace_all[v].size() / TRACE_NCOL;
 	}
 
+	NumericMatrix trace(n_rows, TRACE_NCOL);
+	int row = 0;
+	for(int v=0 ; v<n_vars ; ++v){
+		const vector<double> &my_trace = trace_all[v];
+		int my_n_rows = my_trace.size() / TRACE_NCOL;
+		for(int r=0 ; r<my_n_rows ; ++r){
+			for(int k=0 ; k<TRACE_NCOL ; ++k){
+				trace(row, k) = my_trace[r*TRACE_NCOL + k];
+			}
+			++row;
+		}
+	}
 
-	if(*(args.stopnow)){
-		stop("cpp_demean: User interrupt.");
+	return trace;
+}
+
+// Loop over demean_single
+// [[Rcpp::export]]
+List cpp_demean(SEXP y, SEXP X_raw, SEXP r_weights, int iterMax, double diffMax, SEXP nb_cluster_all,
+                SEXP dum_vector, SEXP tableCluster_vector, SEXP slope_flag, SEXP slope_vars,
+                SEXP r_init, int checkWeight, int nthreads, bool save_fixef = false, int trace_every = 0){
+	// main fun that calls demean_single
+	// preformat all the information needed on the clusters
+	// y: the dependent variable
+	// X_raw: the matrix of the explanatory variables -- can be "empty"
+
+	// when including weights: recreate table values
+	// export weights and isWeight bool
+
+	// slope_flag: whether a FE is a varying slope
+	// slope_var: the associated variables with varying slopes
+
+	// trace_every: if > 0, the convergence trace is saved every trace_every iterations
+	//  (see dm_trace_add for the columns)
+
+	//initial variables
+	int n_obs = Rf_length(y);
+	bool isWeight = Rf_length(r_weights) != 1;
+
+	// whether we use X_raw
+	int n_X = Rf_length(X_raw);
+	int n_vars;
+	bool useX;
+	if(n_X == 1){
+		// means X_raw not needed
+		n_vars = 1; // only y
+		useX = false;
+	} else {
+		n_vars = n_X / n_obs + 1;
+		useX = true;
 	}
 
-	// Rprintf("Master checking: %i\n", *pcounter);
+	// initialisation if needed
+	bool isInit = Rf_length(r_init) != 1;
+	double *init = REAL(r_init);
+	bool saveInit = isInit || init[0] != 0;
+
+	// FEs + weights
+	DEMEAN_FE fe;
+	dm_fe_setup(fe, n_obs, nb_cluster_all, dum_vector, tableCluster_vector, slope_flag, slope_vars);
+	dm_fe_set_weights(fe, REAL(r_weights), isWeight, checkWeight);
+	int nb_coef = fe.nb_coef;
+
+	// we put all input variables into a single vector
+	// the dep var is the last one
+	vector<double> input_values(n_obs*n_vars);
+
+	if(useX){
+		double* pX_raw = REAL(X_raw);
+		for(int i = 0 ; i < (n_obs*(n_vars - 1)) ; ++i){
+			input_values[i] = pX_raw[i];
+		}
+	}
+
+	double* py = REAL(y);
+	int y_start = n_obs*(n_vars - 1);
+	for(int i = 0 ; i < n_obs ; ++i){
+		input_values[y_start + i] = py[i];
+	}
+
+	// output vector:
+	vector<double> output_values(n_obs*n_vars, 0);
+
+	if(isInit){
+		for(int i=0 ; i<(n_obs*n_vars) ; ++i){
+			output_values[i] = init[i];
+		}
+	}
+
+	// keeping track of iterations
+	vector<int> iterations_all(n_vars, 0);
+
+	// save fixef option
+	if(useX && save_fixef){
+	    stop("save_fixef can be used only when there is no Xs.");
+	}
+
+	vector<double> fixef_values(save_fixef ? nb_coef : 1, 0);
+
+	// convergence trace
+	vector< vector<double> > trace_all;
+
+	bool ok = dm_run(fe, n_vars, input_values.data(), output_values.data(), iterMax, diffMax,
+                  nthreads, iterations_all.data(), save_fixef, fixef_values.data(),
+                  trace_every, trace_all);
+
+	if(!ok){
+		stop("cpp_demean: User interrupt.");
+	}
 
 	//
 	// save
@@ -1425,7 +1707,7 @@ List cpp_demean(SEXP y, SEXP X_raw, SEXP r_weights, int iterMax, double diffMax,
 	// iterations
 	IntegerVector iter_final(n_vars);
 	for(int v=0 ; v<n_vars ; ++v){
-		iter_final[v] = piterations_all[v];
+		iter_final[v] = iterations_all[v];
 	}
 
 	// if save is requested
@@ -1450,10 +1732,938 @@ List cpp_demean(SEXP y, SEXP X_raw, SEXP r_weights, int iterMax, double diffMax,
 	res["means"] = saved_output;
 	res["fixef_coef"] = saved_fixef_coef;
 
+	if(trace_every > 0){
+		res["trace"] = dm_trace_to_matrix(trace_all);
+	}
+
 	return(res);
 }
 
 
+//
+// IRLS
+//
+
+// The IRLS algorithm of feglm.fit, for the families defined in glm_family.h
+// It's the same algorithm as in R (same steps, same step-halving, same messages)
+// but all the vectors of length n are allocated once and the demeaning reuses
+// its setup (only the weights change) and the means of the previous iteration.
+// When the weighted OLS cannot be solved (collinearity), it returns fallback = TRUE
+// and the R algorithm takes over (it handles collinearity with a generalized inverse),
+// from the point where the C++ algorithm stopped (see irls_fallback).
+
+void irls_crossprod(int n, int K, const double *X, const double *w, vector<double> &xwx, int nthreads){
+	// same as cpppar_crossprod, on raw data
+
+	int nValues = K * K;
+
+	#pragma omp parallel for num_threads(nthreads)
+	for(int index=0 ; index<nValues ; index++){
+		int k_row = index % K;
+		int k_col = index / K;
+
+		if(k_row <= k_col){
+			const double *X_row = X + k_row * n;
+			const double *X_col = X + k_col * n;
+			double val = 0;
+			for(int i=0 ; i<n ; ++i){
+				val += X_row[i] * w[i] * X_col[i];
+			}
+
+			xwx[index] = val;
+			xwx[k_row * K + k_col] = val;
+		}
+	}
+}
+
+bool irls_solve_chol(int K, const vector<double> &xwx, const vector<double> &xwy, vector<double> &beta){
+	// solves xwx * beta = xwy with a Cholesky decomposition
+	// returns false if xwx is not (numerically) positive definite
+
+	vector<double> L(K * K, 0);
+
+	double max_diag = 0;
+	for(int k=0 ; k<K ; ++k){
+		if(xwx[k*K + k] > max_diag) max_diag = xwx[k*K + k];
+	}
+	double tol = max_diag * K * DOUBLE_EPS;
+
+	for(int j=0 ; j<K ; ++j){
+		double value = xwx[j*K + j];
+		for(int l=0 ; l<j ; ++l){
+			value -= L[j*K + l] * L[j*K + l];
+		}
+
+		if(!(value > tol)){
+			return false;
+		}
+
+		double L_jj = sqrt(value);
+		L[j*K + j] = L_jj;
+
+		for(int i=j+1 ; i<K ; ++i){
+			double value_ij = xwx[j*K + i];
+			for(int l=0 ; l<j ; ++l){
+				value_ij -= L[i*K + l] * L[j*K + l];
+			}
+			L[i*K + j] = value_ij / L_jj;
+		}
+	}
+
+	// L * a = xwy
+	vector<double> a(K);
+	for(int i=0 ; i<K ; ++i){
+		double value = xwy[i];
+		for(int l=0 ; l<i ; ++l){
+			value -= L[i*K + l] * a[l];
+		}
+		a[i] = value / L[i*K + i];
+	}
+
+	// t(L) * beta = a
+	for(int i=K-1 ; i>=0 ; --i){
+		double value = a[i];
+		for(int l=i+1 ; l<K ; ++l){
+			value -= L[l*K + i] * beta[l];
+		}
+		beta[i] = value / L[i*K + i];
+	}
+
+	return true;
+}
+
+void irls_fallback(List &res, int iter, const vector<double> &eta, const vector<double> &mu,
+                   const double *fitted_old, double devold, int nb_sh){
+	// the R algorithm restarts from the current point: eta/mu, the previous linear
+	// predictor (w/t offset) and deviance for the step-halving, the iterations done
+
+	int n = eta.size();
+	NumericVector r_eta(n), r_mu(n), r_eta_old(n);
+	for(int i=0 ; i<n ; ++i){
+		r_eta[i] = eta[i];
+		r_mu[i] = mu[i];
+		r_eta_old[i] = fitted_old[i];
+	}
+
+	res["fallback"] = true;
+	res["eta"] = r_eta;
+	res["mu"] = r_mu;
+	res["eta_old"] = r_eta_old;
+	res["devold"] = devold;
+	res["iter"] = iter - 1;
+	res["nb_sh"] = nb_sh;
+}
+
+std::string irls_msg(const char *msg, int iter){
+	char buffer[200];
+	snprintf(buffer, 200, msg, iter);
+	return std::string(buffer);
+}
+
+// inexact demeaning in the IRLS: tolerance = forcing term * relative change in deviance
+const double IRLS_FIXEF_FORCING = 0.1;
+
+// [[Rcpp::export]]
+List cpp_irls(int family, SEXP r_y, SEXP r_X, SEXP r_offset, SEXP r_weights, SEXP r_eta, SEXP r_mu,
+              SEXP r_eta_old, double devold, int glm_iter, double glm_tol,
+              bool isFixef, SEXP nb_cluster_all, SEXP dum_vector, SEXP tableCluster_vector,
+              SEXP slope_flag, SEXP slope_vars, int fixef_iter, double fixef_tol, int nthreads,
+              int trace_every = 0){
+	// family: see glm_family.h
+	// eta, mu: starting values
+	// eta_old, devold: the linear predictor (w/t offset) and the deviance before the first iteration
+	//  (used in the step-halving)
+	// trace_every: if > 0, the convergence trace of the last demeaning is returned
+
+	int n = Rf_length(r_y);
+	double *y = REAL(r_y);
+
+	bool onlyFixef = Rf_length(r_X) == 1;
+	int K = onlyFixef ? 0 : Rf_length(r_X) / n;
+	int n_vars = K + 1;
+	double *X = REAL(r_X);
+
+	bool isOffset = Rf_length(r_offset) != 1;
+	double *offset = REAL(r_offset);
+	bool isWeight = Rf_length(r_weights) != 1;
+	double *weights = REAL(r_weights);
+
+	// for the fused passes
+	const double *p_offset = isOffset ? offset : nullptr;
+	const double *p_weights = isWeight ? weights : nullptr;
+
+	List res;
+
+	//
+	// Buffers
+	//
+
+	vector<double> eta(REAL(r_eta), REAL(r_eta) + n);
+	vector<double> mu(REAL(r_mu), REAL(r_mu) + n);
+	// z/w: working response and weights of the current iteration
+	// z_next/w_next: the ones computed with the last values of eta/mu (see glm_fused_pass)
+	vector<double> z(n), w(n), z_next(n), w_next(n);
+	// eta within the step-halving
+	vector<double> eta_sh(n);
+
+	// the weighted OLS: current and previous (wols/wols_old in R)
+	// we swap the pointers when wols_old = wols
+	vector<double> fitted_a(n), fitted_b(REAL(r_eta_old), REAL(r_eta_old) + n);
+	vector<double> resid_a(n), resid_b(n, NA_REAL);
+	vector<double> coef_a(K), coef_b(K, NA_REAL);
+	double *fitted = fitted_a.data(), *fitted_old = fitted_b.data();
+	double *resid = resid_a.data(), *resid_old = resid_b.data();
+	double *coef = coef_a.data(), *coef_old = coef_b.data();
+
+	// demeaned X: R matrices (returned)
+	NumericMatrix X_dm_a, X_dm_b;
+	if(isFixef && !onlyFixef){
+		X_dm_a = NumericMatrix(n, K);
+		X_dm_b = NumericMatrix(n, K);
+	}
+	NumericMatrix *X_dm = &X_dm_a, *X_dm_old = &X_dm_b;
+
+	// demeaning: setup + input (X, then z) + means (kept from one iteration to the other)
+	DEMEAN_FE fe;
+	vector<double> input_values, output_values;
+	vector<int> iterations(n_vars);
+	vector< vector<double> > trace_all;
+	vector<double> fixef_values(1);
+
+	if(isFixef){
+		dm_fe_setup(fe, n, nb_cluster_all, dum_vector, tableCluster_vector, slope_flag, slope_vars);
+		input_values.resize(n * n_vars);
+		output_values.assign(n * n_vars, 0);
+		for(int i=0 ; i<n*K ; ++i){
+			input_values[i] = X[i];
+		}
+	}
+
+	// X and z after demeaning
+	double *z_dm = nullptr;
+	vector<double> xwx(K * K), xwy(K), beta(K);
+
+	// Inexact demeaning: the precision of the demeaning follows the convergence of the IRLS
+	// (with the warm start, demeaning precisely z while the deviance is far from
+	//  convergence is a waste of time)
+	// tolerance at step t: IRLS_FIXEF_FORCING * relative change in deviance at step t-1,
+	// within [fixef_tol_min, fixef_tol_max]
+	// fixef_tol_min is 10 * fixef_tol, it falls to fixef_tol if the deviance stagnates
+	// (then the error of the demeaning prevents the convergence)
+	// If the IRLS converges with a loose tolerance, one more step is done at full precision.
+	double fixef_tol_max = fixef_tol * 1000 < 1e-3 ? fixef_tol * 1000 : 1e-3;
+	if(fixef_tol_max < fixef_tol) fixef_tol_max = fixef_tol;
+	double fixef_tol_min = fixef_tol * 10 < fixef_tol_max ? fixef_tol * 10 : fixef_tol_max;
+	if(isFixef && fe.Q == 1 && !fe.isSlope){
+		// the demeaning is direct: no gain
+		fixef_tol_max = fixef_tol_min = fixef_tol;
+	}
+	double fixef_tol_current = fixef_tol_max;
+	bool fixef_tol_full = false;
+	double dev_rel_evol_old = R_PosInf;
+	// reported: tolerance and max number of iterations of the demeaning, at each step
+	vector<double> fixef_tol_all;
+	vector<int> fixef_iter_all;
+
+	//
+	// The main loop
+	//
 
+	bool conv = false;
+	int nb_sh = 0;
+	std::string warning_msg = "", div_message = "";
+	double dev = devold;
 
+	// z/w from the starting values
+	GLM_PASS pass;
+	glm_fused_pass(family, n, y, nullptr, p_offset, p_weights, eta.data(), mu.data(),
+                z_next.data(), w_next.data(), false, pass, nthreads);
 
+	int iter = 0;
+	for(iter = 1 ; iter <= glm_iter ; ++iter){
+
+		R_CheckUserInterrupt();
+
+		// controls of V(mu) and d(mu)/d(eta), done in the last pass
+		if(pass.any_na_var){
+			stop(irls_msg("NAs in V(mu), at iteration %i.", iter));
+		} else if(pass.any_0_var){
+			stop(irls_msg("0s in V(mu), at iteration %i.", iter));
+		} else if(pass.any_na_mueta){
+			stop(irls_msg("NAs in d(mu)/d(eta), at iteration %i.", iter));
+		}
+
+		// working response and weights
+		std::swap(z, z_next);
+		std::swap(w, w_next);
+		if(!isFixef){
+			z_dm = z.data();
+		}
+
+		if(pass.n_0w == n){
+			if(iter == 1){
+				// no previous estimation to report
+				irls_fallback(res, iter, eta, mu, fitted_old, devold, nb_sh);
+				return res;
+			}
+
+			warning_msg = irls_msg("No informative observation at iteration %i.", iter);
+			div_message = "No informative observation.";
+			// wols is not updated
+			std::swap(fitted, fitted_old);
+			std::swap(resid, resid_old);
+			std::swap(coef, coef_old);
+			std::swap(X_dm, X_dm_old);
+			break;
+		}
+
+		//
+		// weighted OLS
+		//
+
+		if(isFixef){
+			// demeaning, the means of the previous iteration are the starting values
+			double *z_in = input_values.data() + n * K;
+			for(int i=0 ; i<n ; ++i){
+				z_in[i] = z[i];
+			}
+
+			dm_fe_set_weights(fe, w.data(), true, true);
+
+			double diffMax = fixef_tol_full ? fixef_tol : fixef_tol_current;
+			bool ok = dm_run(fe, n_vars, input_values.data(), output_values.data(), fixef_iter, diffMax,
+                       nthreads, iterations.data(), false, fixef_values.data(), trace_every, trace_all);
+
+			if(!ok){
+				stop("cpp_irls: User interrupt.");
+			}
+
+			int iter_max = 0;
+			for(int v=0 ; v<n_vars ; ++v){
+				if(iterations[v] > iter_max) iter_max = iterations[v];
+			}
+			fixef_tol_all.push_back(diffMax);
+			fixef_iter_all.push_back(iter_max);
+
+			// z_dm is stored in resid (resid = z_dm - X_dm * beta)
+			double *z_out = output_values.data() + n * K;
+			for(int i=0 ; i<n ; ++i){
+				resid[i] = z[i] - z_out[i];
+			}
+			z_dm = resid;
+
+			double *pX_dm = REAL(*X_dm);
+			#pragma omp parallel for num_threads(nthreads)
+			for(int i=0 ; i<n*K ; ++i){
+				pX_dm[i] = input_values[i] - output_values[i];
+			}
+		}
+
+		double *pX_dm = isFixef ? (onlyFixef ? nullptr : REAL(*X_dm)) : X;
+
+		bool any_na_coef = false;
+		if(K > 0){
+			irls_crossprod(n, K, pX_dm, w.data(), xwx, nthreads);
+
+			#pragma omp parallel for num_threads(nthreads)
+			for(int k=0 ; k<K ; ++k){
+				double *my_X = pX_dm + k * n;
+				double value = 0;
+				for(int i=0 ; i<n ; ++i){
+					value += my_X[i] * w[i] * z_dm[i];
+				}
+				xwy[k] = value;
+			}
+
+			if(!irls_solve_chol(K, xwx, xwy, beta)){
+				// collinearity => the R algorithm takes over
+				irls_fallback(res, iter, eta, mu, fitted_old, devold, nb_sh);
+				return res;
+			}
+
+			for(int k=0 ; k<K ; ++k){
+				coef[k] = beta[k];
+				any_na_coef = any_na_coef || std::isnan(beta[k]);
+			}
+
+			// residuals: z_dm - X_dm * beta
+			#pragma omp parallel for num_threads(nthreads)
+			for(int i=0 ; i<n ; ++i){
+				double value = 0;
+				for(int k=0 ; k<K ; ++k){
+					value += pX_dm[k * n + i] * beta[k];
+				}
+				resid[i] = z_dm[i] - value;
+			}
+		} else if(!isFixef){
+			// no variable, no FE: nothing to estimate
+			for(int i=0 ; i<n ; ++i){
+				resid[i] = z[i];
+			}
+		}
+
+		// In theory OLS estimation is guaranteed to exist
+		// yet, NA coef may happen with non-infinite very large values of z/w (e.g. values > 1e100)
+		if(any_na_coef){
+			if(iter == 1){
+				stop("Weighted-OLS returns NA coefficients at first iteration, step halving cannot be performed. Try other starting values?");
+			}
+
+			warning_msg = irls_msg("Divergence at iteration %i: Weighted-OLS returns NA coefficients. Last evaluated coefficients with finite deviance are returned for information purposes.", iter);
+			div_message = "Weighted-OLS returned NA coefficients.";
+			std::swap(fitted, fitted_old);
+			std::swap(resid, resid_old);
+			std::swap(coef, coef_old);
+			std::swap(X_dm, X_dm_old);
+			break;
+		}
+
+		// new eta/mu
+		#pragma omp parallel for num_threads(nthreads)
+		for(int i=0 ; i<n ; ++i){
+			fitted[i] = z[i] - resid[i];
+		}
+
+		glm_fused_pass(family, n, y, fitted, p_offset, p_weights, eta.data(), mu.data(),
+                 z_next.data(), w_next.data(), true, pass, nthreads);
+
+		dev = pass.dev;
+		double dev_evol = dev - devold;
+
+		//
+		// STEP HALVING
+		//
+
+		if(!std::isfinite(dev) || dev_evol > 0 || !pass.valid_eta || !pass.valid_mu){
+
+			if(!std::isfinite(dev)){
+				// we report step-halving but only for non-finite deviances
+				// other situations are OK (it just happens)
+				++nb_sh;
+			}
+
+			// eta_new: fitted (eta_old: fitted_old)
+			int iter_sh = 0;
+			bool do_exit = false;
+			bool valid = pass.valid_fitted && pass.valid_mu;
+			while(!std::isfinite(dev) || dev_evol > 0 || !valid){
+
+				if(iter == 1 && std::isfinite(dev) && valid && iter_sh >= 2){
+					// BEWARE FIRST ITERATION:
+					// at first iteration, the deviance can be higher than the init, and SH may not help
+					// we need to make sure we get out of SH before it's messed up
+					break;
+				} else if(iter_sh == glm_iter){
+
+					// if first iteration => means algo did not find viable solution
+					if(iter == 1){
+						stop("Algorithm failed at first iteration. Step-halving could not find a valid set of parameters.");
+					}
+
+					// message
+					std::string msg = !std::isfinite(dev) ? "non-finite deviance" : (dev_evol > 0 ? "no reduction in deviance" : "no valid eta/mu");
+
+					warning_msg = irls_msg("Divergence at iteration %i: ", iter) + msg + ". Step halving: no valid correction found. Last evaluated coefficients with finite deviance are returned for information purposes.";
+					div_message = msg + " despite step-halving";
+					std::swap(fitted, fitted_old);
+					std::swap(resid, resid_old);
+					std::swap(coef, coef_old);
+					std::swap(X_dm, X_dm_old);
+					do_exit = true;
+					break;
+				}
+
+				++iter_sh;
+
+				#pragma omp parallel for num_threads(nthreads)
+				for(int i=0 ; i<n ; ++i){
+					fitted[i] = (fitted_old[i] + fitted[i]) / 2;
+				}
+
+				glm_fused_pass(family, n, y, fitted, p_offset, p_weights, eta_sh.data(), mu.data(),
+                     z_next.data(), w_next.data(), true, pass, nthreads);
+
+				dev = pass.dev;
+				dev_evol = dev - devold;
+				valid = pass.valid_fitted && pass.valid_mu;
+			}
+
+			if(do_exit) break;
+
+			// it worked: update (eta_sh = fitted + offset)
+			if(iter_sh > 0){
+				std::swap(eta, eta_sh);
+			}
+			// NOTA: we must NOT end with a step halving => we need a proper weighted-ols estimation
+			// we force the algorithm to continue
+			dev_evol = R_PosInf;
+		}
+
+		double dev_rel_evol = fabs(dev_evol)/(0.1 + fabs(dev));
+		if(dev_rel_evol < glm_tol && (!isFixef || fixef_tol_full || fixef_tol_current <= fixef_tol)){
+			conv = true;
+			break;
+		} else {
+			if(dev_rel_evol < glm_tol){
+				// converged with an inexact demeaning: last step at full precision
+				fixef_tol_full = true;
+			} else if(std::isfinite(dev_rel_evol)){
+				// not after step-halving
+				if(dev_rel_evol > dev_rel_evol_old / 2){
+					fixef_tol_min = fixef_tol;
+				}
+				dev_rel_evol_old = dev_rel_evol;
+
+				double tol = IRLS_FIXEF_FORCING * dev_rel_evol;
+				fixef_tol_current = tol < fixef_tol_min ? fixef_tol_min : (tol > fixef_tol_max ? fixef_tol_max : tol);
+			}
+
+			devold = dev;
+			std::swap(fitted, fitted_old);
+			std::swap(resid, resid_old);
+			std::swap(coef, coef_old);
+			std::swap(X_dm, X_dm_old);
+		}
+	}
+
+	if(!conv && iter > glm_iter){
+		// the for loop of R ends with iter = glm.iter
+		iter = glm_iter;
+		// wols_old = wols was applied: the last estimation is in *_old
+		std::swap(fitted, fitted_old);
+		std::swap(resid, resid_old);
+		std::swap(coef, coef_old);
+		std::swap(X_dm, X_dm_old);
+	}
+
+	//
+	// Results
+	//
+
+	NumericVector r_coef(K), r_fitted(n), r_resid(n), r_w(n), r_eta_final(n), r_mu_final(n);
+	for(int k=0 ; k<K ; ++k){
+		r_coef[k] = coef[k];
+	}
+
+	for(int i=0 ; i<n ; ++i){
+		r_fitted[i] = fitted[i];
+		r_resid[i] = resid[i];
+		r_w[i] = w[i];
+		r_eta_final[i] = eta[i];
+		r_mu_final[i] = mu[i];
+	}
+
+	res["fallback"] = false;
+	res["coefficients"] = r_coef;
+	res["fitted.values"] = r_fitted;
+	res["residuals"] = r_resid;
+	if(!onlyFixef){
+		if(isFixef){
+			res["X_demean"] = *X_dm;
+		} else {
+			res["X_demean"] = r_X;
+		}
+	}
+	res["w"] = r_w;
+	res["eta"] = r_eta_final;
+	res["mu"] = r_mu_final;
+	res["deviance"] = dev;
+	res["iter"] = iter;
+	res["conv"] = conv;
+	res["nb_sh"] = nb_sh;
+	res["warning_msg"] = warning_msg;
+	res["div_message"] = div_message;
+	if(isFixef && trace_every > 0){
+		res["trace"] = dm_trace_to_matrix(trace_all);
+	}
+	if(isFixef){
+		res["fixef_tol"] = fixef_tol_all;
+		res["fixef_iter"] = fixef_iter_all;
+	}
+
+	return res;
+}
+
+
+//
+// Separation
+//
+
+// In Poisson (and negbin) models, the ML estimates do not exist when some observations
+// with a 0 outcome can be perfectly predicted: there exists a combination z of the
+// regressors and of the FEs such that z = 0 for y > 0 and z >= 0 for y = 0 (z > 0 for at least
+// one observation). These observations are "separated": their fitted value goes to 0, the
+// coefficients go to infinity and the algorithms never converge.
+// The FE case (clusters with only 0 outcomes) is handled by cpp_fe_prune.
+// Here we use the iterative rectifier of Correia, Guimaraes and Zylkin (2019): the
+// regression of u on the regressors and the FEs is repeated, with u the positive part
+// of the previous fit, and large weights for y > 0 (which forces the fit to 0 there).
+// When the fit has no negative value, the observations with a positive fit are separated.
+
+// [[Rcpp::export]]
+List cpp_fe_prune(SEXP dum_list, SEXP nb_cluster_all, SEXP check, SEXP r_y, bool is_logit,
+                  SEXP removed_init = R_NilValue){
+	// Removes, iteratively, the clusters with only 0 outcomes (or only 1 outcomes for logit)
+	// Removing the observations of one cluster can create new such clusters in the other FEs,
+	// so we go on until there is none left.
+	// dum_list: list of the cluster IDs, starting at 1
+	// check: logical, for each FE, whether it should be checked (not the case for pure slopes)
+	// removed_init: logical (or NULL), the observations already removed (e.g. separation)
+	// Returns:
+	// - removed: logical, the observations to remove
+	// - fixef_removed: for each FE, the IDs (starting at 1) of the clusters removed
+
+	int Q = Rf_length(nb_cluster_all);
+	int n = Rf_length(r_y);
+	int *pcluster = INTEGER(nb_cluster_all);
+	int *pcheck = LOGICAL(check);
+	double *y = REAL(r_y);
+
+	vector<int*> pdum(Q);
+	for(int q=0 ; q<Q ; ++q){
+		pdum[q] = INTEGER(VECTOR_ELT(dum_list, q));
+	}
+
+	LogicalVector removed(n);
+	if(!Rf_isNull(removed_init)){
+		int *pinit = LOGICAL(removed_init);
+		for(int i=0 ; i<n ; ++i){
+			removed[i] = pinit[i];
+		}
+	}
+
+	// For each checked FE: number of obs, of positive outcomes (and of 1s for logit),
+	// and the observations of each cluster
+	vector< vector<int> > count(Q), n_pos(Q), n_one(Q), start(Q), obs(Q);
+	vector< vector<bool> > is_removed(Q);
+	for(int q=0 ; q<Q ; ++q){
+		if(!pcheck[q]) continue;
+
+		int K = pcluster[q];
+		int *my_dum = pdum[q];
+		count[q].assign(K, 0);
+		n_pos[q].assign(K, 0);
+		n_one[q].assign(K, 0);
+		is_removed[q].assign(K, false);
+
+		vector<int> &my_start = start[q];
+		my_start.assign(K + 1, 0);
+		for(int i=0 ; i<n ; ++i){
+			++my_start[my_dum[i]];
+		}
+		for(int k=0 ; k<K ; ++k){
+			my_start[k + 1] += my_start[k];
+		}
+
+		obs[q].resize(n);
+		vector<int> position(my_start.begin(), my_start.end() - 1);
+		for(int i=0 ; i<n ; ++i){
+			int k = my_dum[i] - 1;
+			obs[q][position[k]++] = i;
+		}
+
+		for(int i=0 ; i<n ; ++i){
+			if(removed[i]) continue;
+			int k = my_dum[i] - 1;
+			++count[q][k];
+			if(y[i] > 0) ++n_pos[q][k];
+			if(y[i] == 1) ++n_one[q][k];
+		}
+	}
+
+	// stack of the (FE, cluster) to remove
+	vector<int> stack_q, stack_k;
+	for(int q=0 ; q<Q ; ++q){
+		if(!pcheck[q]) continue;
+		for(int k=0 ; k<pcluster[q] ; ++k){
+			if(count[q][k] > 0 && (n_pos[q][k] == 0 || (is_logit && n_one[q][k] == count[q][k]))){
+				stack_q.push_back(q);
+				stack_k.push_back(k);
+			}
+		}
+	}
+
+	while(!stack_q.empty()){
+		int q = stack_q.back(), k = stack_k.back();
+		stack_q.pop_back();
+		stack_k.pop_back();
+
+		if(is_removed[q][k]) continue;
+		is_removed[q][k] = true;
+
+		for(int j=start[q][k] ; j<start[q][k + 1] ; ++j){
+			int i = obs[q][j];
+			if(removed[i]) continue;
+			removed[i] = true;
+
+			// we update the other FEs
+			for(int h=0 ; h<Q ; ++h){
+				if(h == q || !pcheck[h]) continue;
+
+				int k_h = pdum[h][i] - 1;
+				--count[h][k_h];
+				if(y[i] > 0) --n_pos[h][k_h];
+				if(y[i] == 1) --n_one[h][k_h];
+
+				if(!is_removed[h][k_h] && count[h][k_h] > 0 &&
+				   (n_pos[h][k_h] == 0 || (is_logit && n_one[h][k_h] == count[h][k_h]))){
+					stack_q.push_back(h);
+					stack_k.push_back(k_h);
+				}
+			}
+		}
+	}
+
+	List fixef_removed(Q);
+	for(int q=0 ; q<Q ; ++q){
+		vector<int> id_removed;
+		if(pcheck[q]){
+			for(int k=0 ; k<pcluster[q] ; ++k){
+				if(is_removed[q][k]) id_removed.push_back(k + 1);
+			}
+		}
+		fixef_removed[q] = id_removed;
+	}
+
+	List res;
+	res["removed"] = removed;
+	res["fixef_removed"] = fixef_removed;
+
+	return res;
+}
+
+void chol_solve_drop(int K, const vector<double> &xwx, const vector<double> &xwy, vector<double> &beta){
+	// same as irls_solve_chol, but the collinear variables are dropped (their coef is 0)
+	// instead of returning an error
+
+	vector<double> L(K * K, 0);
+	vector<bool> is_dropped(K, false);
+
+	double max_diag = 0;
+	for(int k=0 ; k<K ; ++k){
+		if(xwx[k*K + k] > max_diag) max_diag = xwx[k*K + k];
+	}
+	double tol = max_diag * K * 1e-10;
+
+	for(int j=0 ; j<K ; ++j){
+		double value = xwx[j*K + j];
+		for(int l=0 ; l<j ; ++l){
+			value -= L[j*K + l] * L[j*K + l];
+		}
+
+		if(!(value > tol)){
+			is_dropped[j] = true;
+			continue;
+		}
+
+		double L_jj = sqrt(value);
+		L[j*K + j] = L_jj;
+
+		for(int i=j+1 ; i<K ; ++i){
+			double value_ij = xwx[j*K + i];
+			for(int l=0 ; l<j ; ++l){
+				value_ij -= L[i*K + l] * L[j*K + l];
+			}
+			L[i*K + j] = value_ij / L_jj;
+		}
+	}
+
+	// L * a = xwy (the dropped variables have a zero column in L)
+	vector<double> a(K, 0);
+	for(int i=0 ; i<K ; ++i){
+		if(is_dropped[i]) continue;
+		double value = xwy[i];
+		for(int l=0 ; l<i ; ++l){
+			value -= L[i*K + l] * a[l];
+		}
+		a[i] = value / L[i*K + i];
+	}
+
+	// t(L) * beta = a
+	for(int i=K-1 ; i>=0 ; --i){
+		if(is_dropped[i]){
+			beta[i] = 0;
+			continue;
+		}
+		double value = a[i];
+		for(int l=i+1 ; l<K ; ++l){
+			value -= L[l*K + i] * beta[l];
+		}
+		beta[i] = value / L[i*K + i];
+	}
+}
+
+// [[Rcpp::export]]
+List cpp_separation_relu(SEXP r_y, SEXP r_X, SEXP r_removed, bool isFixef, SEXP nb_cluster_all,
+                         SEXP dum_vector, SEXP tableCluster_vector, int iterMax, int fixef_iter,
+                         double fixef_tol, double tol, int nthreads){
+	// r_X: the regressors (a matrix, or 0 if there are none)
+	// r_removed: logical, the observations already removed (they get a 0 weight)
+	// tol: the fitted values lower than tol (in absolute value) are considered as 0
+	// Returns:
+	// - separated: the indexes (starting at 1) of the separated observations
+	// - iter: the number of iterations
+	// - conv: whether the algorithm converged (if not, separated is empty)
+
+	int n = Rf_length(r_y);
+	int K = Rf_length(r_X) == 1 ? 0 : Rf_length(r_X) / n;
+	double *y = REAL(r_y);
+	int *removed = LOGICAL(r_removed);
+
+	// weight of the observations with a positive outcome
+	const double weight_pos = 1e6;
+
+	vector<double> w(n);
+	vector<double> u(n);
+	for(int i=0 ; i<n ; ++i){
+		if(removed[i]){
+			w[i] = 0;
+			u[i] = 0;
+		} else if(y[i] > 0){
+			w[i] = weight_pos;
+			u[i] = 0;
+		} else {
+			w[i] = 1;
+			u[i] = 1;
+		}
+	}
+
+	// the FEs
+	DEMEAN_FE fe;
+	vector< vector<double> > trace_all;
+	SEXP slope_flag = PROTECT(Rf_allocVector(INTSXP, isFixef ? Rf_length(nb_cluster_all) : 0));
+	if(isFixef){
+		for(int q=0 ; q<Rf_length(nb_cluster_all) ; ++q){
+			INTEGER(slope_flag)[q] = 0;
+		}
+		dm_fe_setup(fe, n, nb_cluster_all, dum_vector, tableCluster_vector, slope_flag, R_NilValue);
+		dm_fe_set_weights(fe, w.data(), true, true);
+	}
+
+	// the regressors are demeaned once and for all (the weights don't change)
+	vector<double> X_dm(K > 0 ? (size_t)K * n : 1);
+	vector<int> iterations(K + 1);
+	if(K > 0){
+		double *X = REAL(r_X);
+		if(isFixef){
+			vector<double> means((size_t)K * n, 0);
+			if(!dm_run(fe, K, X, means.data(), fixef_iter, fixef_tol, nthreads, iterations.data(), false, nullptr, 0, trace_all)){
+				UNPROTECT(1);
+				stop("cpp_separation_relu: User interrupt.");
+			}
+
+			for(size_t i=0 ; i<(size_t)K * n ; ++i){
+				X_dm[i] = X[i] - means[i];
+			}
+		} else {
+			for(size_t i=0 ; i<(size_t)K * n ; ++i){
+				X_dm[i] = X[i];
+			}
+		}
+	}
+
+	vector<double> xwx(K * K), xwu(K), beta(K);
+	if(K > 0){
+		irls_crossprod(n, K, X_dm.data(), w.data(), xwx, nthreads);
+	}
+
+	vector<double> u_means(n, 0);
+	vector<double> fit(n);
+	bool conv = false;
+	int iter = 0;
+	while(iter < iterMax){
+		R_CheckUserInterrupt();
+		++iter;
+
+		// fit = u - residual of the weighted regression of u on X and the FEs
+		if(isFixef){
+			if(!dm_run(fe, 1, u.data(), u_means.data(), fixef_iter, fixef_tol, nthreads, iterations.data(), false, nullptr, 0, trace_all)){
+				UNPROTECT(1);
+				stop("cpp_separation_relu: User interrupt.");
+			}
+		}
+
+		#pragma omp parallel for num_threads(nthreads)
+		for(int i=0 ; i<n ; ++i){
+			// fit is first the demeaned u
+			fit[i] = u[i] - u_means[i];
+		}
+
+		if(K > 0){
+			for(int k=0 ; k<K ; ++k){
+				const double *my_X = X_dm.data() + (size_t)k * n;
+				double value = 0;
+				for(int i=0 ; i<n ; ++i){
+					value += my_X[i] * w[i] * fit[i];
+				}
+				xwu[k] = value;
+			}
+
+			chol_solve_drop(K, xwx, xwu, beta);
+
+			for(int k=0 ; k<K ; ++k){
+				const double *my_X = X_dm.data() + (size_t)k * n;
+				double b = beta[k];
+				for(int i=0 ; i<n ; ++i){
+					fit[i] -= b * my_X[i];
+				}
+			}
+		}
+
+		// fit = u - resid; values close to 0 are set to 0
+		bool any_negative = false, any_positive = false;
+		for(int i=0 ; i<n ; ++i){
+			if(removed[i]){
+				fit[i] = 0;
+				continue;
+			}
+
+			double value = u[i] - fit[i];
+			if(fabs(value) < tol){
+				value = 0;
+			} else if(value < 0){
+				any_negative = true;
+			} else if(y[i] == 0){
+				any_positive = true;
+			}
+			fit[i] = value;
+		}
+
+		if(!any_negative){
+			conv = true;
+			break;
+		}
+
+		if(!any_positive){
+			// no candidate left => no separation
+			for(int i=0 ; i<n ; ++i){
+				fit[i] = 0;
+			}
+			conv = true;
+			break;
+		}
+
+		// u: positive part of the fit (only for y == 0)
+		for(int i=0 ; i<n ; ++i){
+			u[i] = (y[i] == 0 && fit[i] > 0) ? fit[i] : 0;
+		}
+	}
+
+	vector<int> separated;
+	if(conv){
+		for(int i=0 ; i<n ; ++i){
+			if(y[i] == 0 && fit[i] > 0){
+				separated.push_back(i + 1);
+			}
+		}
+	}
+
+	UNPROTECT(1);
+
+	List res;
+	res["separated"] = separated;
+	res["iter"] = iter;
+	res["conv"] = conv;
+
+	return res;
+}
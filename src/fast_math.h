@@ -0,0 +1,198 @@
+/************************************************************
+ * ____________________                                     *
+ * || Fast exp / log ||                                    *
+ * --------------------                                     *
+ *                                                          *
+ * Versions of exp and log with a max error of a few ulp    *
+ * (vs less than one for libm) but which can be vectorized  *
+ * by the compiler.                                         *
+ *                                                          *
+ * The kernels (fast_exp_core, fast_log_core) only use      *
+ * arithmetic and bit manipulations: no libm call and no    *
+ * branch. They are valid on the "regular" domain only.     *
+ * The values outside (NaN, Inf, under/overflow,            *
+ * subnormals) are sent to libm:                            *
+ *  - in vector loops: the domain is checked in the same    *
+ *    loop, the (rare) blocks with such values are fixed    *
+ *  - in scalar code: directly in fast_exp/fast_log         *
+ * Why not a select within the kernel? Because with the     *
+ * default FP flags (trapping math) a select on the input   *
+ * prevents gcc from vectorizing the loop.                  *
+ *                                                          *
+ * They are opt-in: they're used only when the math         *
+ * accuracy is "fast" (see setFixest_math_accuracy).        *
+ * Otherwise libm is used.                                  *
+ *                                                          *
+ ***********************************************************/
+
+#ifndef FIXEST_FAST_MATH_H
+#define FIXEST_FAST_MATH_H
+
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include <float.h>
+
+// defined in parallel_funs.cpp, set from R (cpp_set_fast_math)
+extern bool fixest_fast_math;
+
+// Cody-Waite split of log(2): the high part has trailing zeros => k*LN2_HI is exact
+const double FM_LN2_HI = 6.93147180369123816490e-01;
+const double FM_LN2_LO = 1.90821492927058770002e-10;
+const double FM_LOG2E = 1.44269504088896338700e+00;
+// x + FM_ROUND - FM_ROUND: rounds x to the nearest integer (for |x| < 2^51)
+const double FM_ROUND = 6755399441055744.0; // 1.5 * 2^52
+const double FM_TWO52 = 4503599627370496.0; // 2^52
+// domain of fast_exp_core: the result is a normal number
+const double FM_EXP_MAX = 708;
+
+inline double fm_from_bits(uint64_t bits){
+	double x;
+	memcpy(&x, &bits, sizeof(double));
+	return x;
+}
+
+inline uint64_t fm_to_bits(double x){
+	uint64_t bits;
+	memcpy(&bits, &x, sizeof(double));
+	return bits;
+}
+
+inline double fast_exp_core(double x){
+	// valid for |x| < FM_EXP_MAX
+	// exp(x) = 2^k * exp(r), with x = k*ln(2) + r and |r| <= ln(2)/2
+
+	double kd = (x * FM_LOG2E + FM_ROUND) - FM_ROUND;
+	double r = (x - kd * FM_LN2_HI) - kd * FM_LN2_LO;
+
+	// Taylor polynomial of degree 12 for exp(r)
+	double p = 1.0 / 479001600;
+	p = p * r + 1.0 / 39916800;
+	p = p * r + 1.0 / 3628800;
+	p = p * r + 1.0 / 362880;
+	p = p * r + 1.0 / 40320;
+	p = p * r + 1.0 / 5040;
+	p = p * r + 1.0 / 720;
+	p = p * r + 1.0 / 120;
+	p = p * r + 1.0 / 24;
+	p = p * r + 1.0 / 6;
+	p = p * r + 0.5;
+	p = p * r + 1.0;
+	p = p * r + 1.0;
+
+	// 2^k: the exponent field is directly written
+	// (k + 1023 + 2^52) has k + 1023 in its lowest bits
+	double scale = fm_from_bits(fm_to_bits(kd + (1023 + FM_TWO52)) << 52);
+
+	return p * scale;
+}
+
+inline double fast_log_core(double x){
+	// valid for DBL_MIN <= x <= DBL_MAX
+	// log(x) = e*ln(2) + log(m), with x = m * 2^e and sqrt(1/2) <= m < sqrt(2)
+	// log(m) = 2*atanh(s), with s = (m - 1) / (m + 1) and |s| <= 0.1716
+
+	// offsetting by the representation of sqrt(1/2) gives the exponent e such that m is in the range
+	uint64_t bits = fm_to_bits(x);
+	uint64_t e_bits = (bits - 0x3fe6a09e667f3bcdULL) & 0xfff0000000000000ULL;
+	double m = fm_from_bits(bits - e_bits);
+	// e (12 bits two's complement) to double, again through the exponent field
+	double e = fm_from_bits(0x4330000000000000ULL | ((e_bits >> 52) ^ 0x800)) - (FM_TWO52 + 2048);
+
+	double s = (m - 1) / (m + 1);
+	double s2 = s * s;
+
+	// series of atanh(s)/s: 1 + s2/3 + s2^2/5 + ...
+	double p = 1.0 / 21;
+	p = p * s2 + 1.0 / 19;
+	p = p * s2 + 1.0 / 17;
+	p = p * s2 + 1.0 / 15;
+	p = p * s2 + 1.0 / 13;
+	p = p * s2 + 1.0 / 11;
+	p = p * s2 + 1.0 / 9;
+	p = p * s2 + 1.0 / 7;
+	p = p * s2 + 1.0 / 5;
+	p = p * s2 + 1.0 / 3;
+
+	double two_s = 2 * s;
+
+	return e * FM_LN2_HI + (two_s + (two_s * s2 * p + e * FM_LN2_LO));
+}
+
+inline double fast_exp(double x){
+	return fabs(x) < FM_EXP_MAX ? fast_exp_core(x) : exp(x);
+}
+
+inline double fast_log(double x){
+	return (x >= DBL_MIN && x <= DBL_MAX) ? fast_log_core(x) : log(x);
+}
+
+// exp/log following the accuracy option, for scalar code
+// (the branch always goes the same way => no cost)
+inline double fm_exp(double x){
+	return fixest_fast_math ? fast_exp(x) : exp(x);
+}
+
+inline double fm_log(double x){
+	return fixest_fast_math ? fast_log(x) : log(x);
+}
+
+// vector versions: x and res must not overlap
+// The domain of the kernel is checked in the same (vectorized) loop, with reductions:
+// the max of |x| (or the min of x), and the sum of x*0 which is NaN if x has a NaN or an Inf.
+// The data is processed by blocks small enough to stay in the cache: the rare blocks with
+// values outside the domain are then fixed with libm.
+const int FM_BLOCK = 512;
+
+inline void fast_exp_vec(int n, const double *x, double *res, int nthreads){
+
+	int n_blocks = (n + FM_BLOCK - 1) / FM_BLOCK;
+
+	#pragma omp parallel for num_threads(nthreads)
+	for(int b=0 ; b<n_blocks ; ++b){
+		int start = b * FM_BLOCK;
+		int end = start + FM_BLOCK < n ? start + FM_BLOCK : n;
+
+		double abs_max = 0, not_finite = 0;
+		#pragma omp simd reduction(max:abs_max) reduction(+:not_finite)
+		for(int i=start ; i<end ; ++i){
+			res[i] = fast_exp_core(x[i]);
+			double abs_x = fabs(x[i]);
+			abs_max = abs_x > abs_max ? abs_x : abs_max;
+			not_finite += x[i] * 0;
+		}
+
+		if(!(abs_max < FM_EXP_MAX && not_finite == 0)){
+			for(int i=start ; i<end ; ++i){
+				if(!(fabs(x[i]) < FM_EXP_MAX)) res[i] = exp(x[i]);
+			}
+		}
+	}
+}
+
+inline void fast_log_vec(int n, const double *x, double *res, int nthreads){
+
+	int n_blocks = (n + FM_BLOCK - 1) / FM_BLOCK;
+
+	#pragma omp parallel for num_threads(nthreads)
+	for(int b=0 ; b<n_blocks ; ++b){
+		int start = b * FM_BLOCK;
+		int end = start + FM_BLOCK < n ? start + FM_BLOCK : n;
+
+		double x_min = DBL_MAX, not_finite = 0;
+		#pragma omp simd reduction(min:x_min) reduction(+:not_finite)
+		for(int i=start ; i<end ; ++i){
+			res[i] = fast_log_core(x[i]);
+			x_min = x[i] < x_min ? x[i] : x_min;
+			not_finite += x[i] * 0;
+		}
+
+		if(!(x_min >= DBL_MIN && not_finite == 0)){
+			for(int i=start ; i<end ; ++i){
+				if(!(x[i] >= DBL_MIN && x[i] <= DBL_MAX)) res[i] = log(x[i]);
+			}
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,573 @@
+/*********************************************************************
+ * _______________________                                           *
+ * || femlm evaluation ||                                            *
+ * -----------------------                                           *
+ *                                                                   *
+ * Log-likelihood, gradient and hessian of the ML families of femlm  *
+ * (poisson, negbin, logit, gaussian).                               *
+ *                                                                   *
+ * The R functions femlm_ll, femlm_gradient and femlm_hessian (which *
+ * are the ones called by nlminb) only call the functions of this    *
+ * file. Each function is one parallel pass over the observations:   *
+ * the derivatives of the family are computed on the fly and never   *
+ * stored (except ll_d2 and ll_dx_dother, which are needed to get    *
+ * the derivatives of the fixed-effects).                            *
+ *                                                                   *
+ * The evaluator is created once per estimation (see the R function  *
+ * get_femlm_eval) and holds the dependent variable and the          *
+ * constants of the likelihood.                                      *
+ *                                                                   *
+ * For the negbin, when y is a count, the evaluator also holds the   *
+ * table of the values of y: the terms lgamma/digamma/trigamma of    *
+ * (theta + y) are then computed once per distinct value of y        *
+ * instead of once per observation.                                  *
+ * cpp_negbin_theta finds theta for a given mu (profile likelihood)  *
+ * with a safeguarded Newton algorithm. It is only used for the null *
+ * model (which gives the starting value of theta): in the main      *
+ * estimation theta remains a parameter of nlminb.                   *
+ *                                                                   *
+ * Family codes are the ones of the convergence algorithms:          *
+ * 1: poisson, 2: negbin, 3: logit, 4: gaussian.                     *
+ *                                                                   *
+ ********************************************************************/
+
+#include <Rcpp.h>
+#include <math.h>
+#include <vector>
+#include <cmath>
+#include <Rmath.h>
+#ifdef _OPENMP
+    #include <omp.h>
+#else
+    #define omp_get_thread_num() 0
+#endif
+#include "fast_math.h"
+
+using namespace Rcpp;
+using std::vector;
+
+// [[Rcpp::plugins(openmp)]]
+
+struct FEMLM_EVAL{
+	int family;
+	int n;
+	// the dependent variable (protected by the external pointer)
+	double *y;
+	int nthreads;
+	// sum(lgamma(y + 1)): poisson and negbin only
+	double sum_lfact;
+	// negbin: distinct values of y and their number of occurrences
+	// (isTable is false if y is not a count)
+	bool isTable;
+	vector<double> y_values;
+	vector<double> y_counts;
+};
+
+FEMLM_EVAL *femlm_eval_get(SEXP eval){
+	// the pointer is NULL if the evaluator was saved and reloaded
+	FEMLM_EVAL *ev = (FEMLM_EVAL *) R_ExternalPtrAddr(eval);
+	if(ev == nullptr){
+		stop("The femlm evaluator is not valid anymore.");
+	}
+	return ev;
+}
+
+inline double log_a_exp(double a, double mu, double exp_mu){
+	// same as cpppar_log_a_exp
+	return mu < 200 ? fm_log(a + exp_mu) : mu;
+}
+
+// Per-thread sums, padded to avoid false sharing.
+// The final sum is done in the order of the threads => the results don't depend on the scheduling.
+int femlm_stride(int n_values){
+	return ((n_values + 7) / 8) * 8;
+}
+
+void femlm_reduce(const vector<double> &all_sums, int nthreads, int n_values, double *res){
+	int stride = femlm_stride(n_values);
+	for(int k=0 ; k<n_values ; ++k){
+		res[k] = 0;
+	}
+	for(int t=0 ; t<nthreads ; ++t){
+		const double *my_sum = all_sums.data() + t * stride;
+		for(int k=0 ; k<n_values ; ++k){
+			res[k] += my_sum[k];
+		}
+	}
+}
+
+void femlm_eval_table(FEMLM_EVAL *ev){
+	// the table is created only if y contains integers in [0, n]
+
+	int n = ev->n;
+	double *y = ev->y;
+
+	ev->isTable = false;
+
+	double y_max = 0;
+	for(int i=0 ; i<n ; ++i){
+		if(y[i] < 0 || y[i] > n || y[i] != floor(y[i])){
+			return;
+		}
+
+		if(y[i] > y_max) y_max = y[i];
+	}
+
+	vector<int> counts(static_cast<int>(y_max) + 1, 0);
+	for(int i=0 ; i<n ; ++i){
+		++counts[static_cast<int>(y[i])];
+	}
+
+	for(int v=0 ; v<=y_max ; ++v){
+		if(counts[v] > 0){
+			ev->y_values.push_back(v);
+			ev->y_counts.push_back(counts[v]);
+		}
+	}
+
+	ev->isTable = true;
+}
+
+double negbin_sum_y(FEMLM_EVAL *ev, double theta, int what){
+	// sum_i f(theta + y_i) with f = lgamma (what = 0), digamma (1) or trigamma (2)
+
+	double res = 0;
+
+	if(ev->isTable){
+		int n_values = ev->y_values.size();
+		for(int v=0 ; v<n_values ; ++v){
+			double x = theta + ev->y_values[v];
+			double value = what == 0 ? lgamma(x) : (what == 1 ? R::digamma(x) : R::trigamma(x));
+			res += ev->y_counts[v] * value;
+		}
+
+	} else {
+		int n = ev->n;
+		double *y = ev->y;
+		#pragma omp parallel for num_threads(ev->nthreads) reduction(+:res)
+		for(int i=0 ; i<n ; ++i){
+			double x = theta + y[i];
+			res += what == 0 ? lgamma(x) : (what == 1 ? R::digamma(x) : R::trigamma(x));
+		}
+	}
+
+	return res;
+}
+
+// [[Rcpp::export]]
+SEXP cpp_femlm_eval(int family, SEXP y, int nthreads){
+	// y is protected by the external pointer (it is not copied)
+
+	if(family < 1 || family > 4){
+		stop("cpp_femlm_eval: wrong family.");
+	}
+
+	FEMLM_EVAL *ev = new FEMLM_EVAL;
+	ev->family = family;
+	ev->n = Rf_length(y);
+	ev->y = REAL(y);
+	ev->nthreads = nthreads;
+	ev->sum_lfact = 0;
+	ev->isTable = false;
+
+	if(family == 2){
+		femlm_eval_table(ev);
+		ev->sum_lfact = negbin_sum_y(ev, 1, 0);
+	} else if(family == 1){
+		int n = ev->n;
+		double *py = ev->y;
+		double sum_lfact = 0;
+		#pragma omp parallel for num_threads(nthreads) reduction(+:sum_lfact)
+		for(int i=0 ; i<n ; ++i){
+			sum_lfact += lgamma(py[i] + 1);
+		}
+		ev->sum_lfact = sum_lfact;
+	}
+
+	XPtr<FEMLM_EVAL> res(ev, true, R_NilValue, y);
+
+	return res;
+}
+
+// [[Rcpp::export]]
+double cpp_femlm_ll(SEXP eval, SEXP r_mu, SEXP r_exp_mu, double theta){
+	// exp_mu: not used for the gaussian family (can be NULL)
+
+	FEMLM_EVAL *ev = femlm_eval_get(eval);
+	int family = ev->family;
+	int n = ev->n;
+	int nthreads = ev->nthreads;
+	double *y = ev->y;
+	double *mu = REAL(r_mu);
+	double *exp_mu = family == 4 ? nullptr : REAL(r_exp_mu);
+
+	double ll = 0;
+
+	if(family == 1){
+		#pragma omp parallel for num_threads(nthreads) reduction(+:ll)
+		for(int i=0 ; i<n ; ++i){
+			ll += y[i] * mu[i] - exp_mu[i];
+		}
+
+		ll -= ev->sum_lfact;
+
+	} else if(family == 2){
+		#pragma omp parallel for num_threads(nthreads) reduction(+:ll)
+		for(int i=0 ; i<n ; ++i){
+			ll += y[i] * mu[i] - (theta + y[i]) * log_a_exp(theta, mu[i], exp_mu[i]);
+		}
+
+		ll += negbin_sum_y(ev, theta, 0) - ev->sum_lfact + n * (- R::lgammafn(theta) + theta * log(theta));
+
+	} else if(family == 3){
+		#pragma omp parallel for num_threads(nthreads) reduction(+:ll)
+		for(int i=0 ; i<n ; ++i){
+			ll += y[i] * mu[i] - log_a_exp(1, mu[i], exp_mu[i]);
+		}
+
+	} else {
+		double ssr = 0;
+		#pragma omp parallel for num_threads(nthreads) reduction(+:ssr)
+		for(int i=0 ; i<n ; ++i){
+			ssr += (y[i] - mu[i]) * (y[i] - mu[i]);
+		}
+
+		double sigma = sqrt(ssr / n);
+		ll = -1 / 2.0 / (sigma * sigma) * ssr - n * log(sigma) - n * log(2 * M_PI) / 2;
+	}
+
+	return ll;
+}
+
+// [[Rcpp::export]]
+NumericVector cpp_femlm_gradient(SEXP eval, SEXP jacob, SEXP r_mu, SEXP r_exp_mu, double theta){
+	// gradient wrt the columns of the jacobian (+ theta for the negbin)
+	// there is no correction for the FEs (they're at their optimal values)
+
+	FEMLM_EVAL *ev = femlm_eval_get(eval);
+	int family = ev->family;
+	int n = ev->n;
+	int nthreads = ev->nthreads;
+	double *y = ev->y;
+	double *mu = REAL(r_mu);
+	double *exp_mu = family == 4 ? nullptr : REAL(r_exp_mu);
+
+	int K = Rf_isNull(jacob) ? 0 : Rf_length(jacob) / n;
+	double *J = K > 0 ? REAL(jacob) : nullptr;
+
+	// values: the K derivatives + 1 extra value (negbin: theta derivative, gaussian: ssr)
+	int n_values = K + 1;
+	int stride = femlm_stride(n_values);
+	vector<double> all_sums(nthreads * stride, 0);
+
+	#pragma omp parallel num_threads(nthreads)
+	{
+		double *my_sum = all_sums.data() + omp_get_thread_num() * stride;
+
+		#pragma omp for schedule(static)
+		for(int i=0 ; i<n ; ++i){
+			double ll_dl, extra = 0;
+
+			if(family == 1){
+				ll_dl = y[i] - exp_mu[i];
+			} else if(family == 2){
+				ll_dl = y[i] - (theta + y[i]) / (theta / exp_mu[i] + 1);
+				// + digamma(theta + y), summed later
+				extra = - log_a_exp(theta, mu[i], exp_mu[i]) - (theta + y[i]) / (theta + exp_mu[i]);
+			} else if(family == 3){
+				ll_dl = y[i] - 1 / (1 + 1 / exp_mu[i]);
+			} else {
+				// divided by sigma^2 later
+				ll_dl = y[i] - mu[i];
+				extra = ll_dl * ll_dl;
+			}
+
+			for(int k=0 ; k<K ; ++k){
+				my_sum[k] += J[(size_t)k * n + i] * ll_dl;
+			}
+			my_sum[K] += extra;
+		}
+	}
+
+	vector<double> sums(n_values);
+	femlm_reduce(all_sums, nthreads, n_values, sums.data());
+
+	bool isNegbin = family == 2;
+	NumericVector res(K + isNegbin);
+
+	for(int k=0 ; k<K ; ++k){
+		res[k] = sums[k];
+	}
+
+	if(family == 4){
+		double sigma = sqrt(sums[K] / n);
+		for(int k=0 ; k<K ; ++k){
+			res[k] /= sigma * sigma;
+		}
+	} else if(isNegbin){
+		res[K] = sums[K] + negbin_sum_y(ev, theta, 1) + n * (- R::digamma(theta) + log(theta) + 1);
+	}
+
+	return res;
+}
+
+// [[Rcpp::export]]
+List cpp_femlm_d2(SEXP eval, SEXP r_mu, SEXP r_exp_mu, double theta){
+	// second derivative of the ll wrt the linear predictor
+	// + the cross derivative wrt theta for the negbin (ll_dx_dother)
+	// they are needed by the derivatives of the fixed-effects
+
+	FEMLM_EVAL *ev = femlm_eval_get(eval);
+	int family = ev->family;
+	int n = ev->n;
+	int nthreads = ev->nthreads;
+	double *y = ev->y;
+	double *mu = REAL(r_mu);
+	double *exp_mu = family == 4 ? nullptr : REAL(r_exp_mu);
+
+	NumericVector ll_d2(n);
+	double *pd2 = REAL(ll_d2);
+
+	List res;
+
+	if(family == 1){
+		#pragma omp parallel for num_threads(nthreads)
+		for(int i=0 ; i<n ; ++i){
+			pd2[i] = -exp_mu[i];
+		}
+
+	} else if(family == 2){
+		NumericVector ll_dx_dother(n);
+		double *pdx = REAL(ll_dx_dother);
+
+		#pragma omp parallel for num_threads(nthreads)
+		for(int i=0 ; i<n ; ++i){
+			double a = theta / exp_mu[i] + 1;
+			double b = theta + exp_mu[i];
+			pd2[i] = - theta * (theta + y[i]) / (a * b);
+			pdx[i] = -1 / (a * a) + y[i] / (a * b);
+		}
+
+		res["ll_dx_dother"] = ll_dx_dother;
+
+	} else if(family == 3){
+		#pragma omp parallel for num_threads(nthreads)
+		for(int i=0 ; i<n ; ++i){
+			pd2[i] = - 1 / ((1 + exp_mu[i]) * (1 + 1 / exp_mu[i]));
+		}
+
+	} else {
+		double ssr = 0;
+		#pragma omp parallel for num_threads(nthreads) reduction(+:ssr)
+		for(int i=0 ; i<n ; ++i){
+			ssr += (y[i] - mu[i]) * (y[i] - mu[i]);
+		}
+
+		double sigma = sqrt(ssr / n);
+		double value = -1 / (sigma * sigma);
+		for(int i=0 ; i<n ; ++i){
+			pd2[i] = value;
+		}
+	}
+
+	res["ll_d2"] = ll_d2;
+
+	return res;
+}
+
+// [[Rcpp::export]]
+NumericMatrix cpp_femlm_hessian(SEXP eval, SEXP jacob, SEXP dxi_dbeta, SEXP ll_d2, SEXP ll_dx_dother,
+                                SEXP dxi_dother, SEXP r_exp_mu, double theta){
+	// Hessian of the ll (not of -ll), with the correction for the FEs:
+	// crossprod(J + dxi_dbeta, (J + dxi_dbeta) * ll_d2)
+	// For the negbin, the last row/column is theta.
+	// dxi_dbeta/dxi_dother: the derivatives of the FEs wrt the coefficients and theta
+	//  (scalar if no FE)
+	// ll_dx_dother/dxi_dother: only used for the negbin
+
+	FEMLM_EVAL *ev = femlm_eval_get(eval);
+	int family = ev->family;
+	int n = ev->n;
+	int nthreads = ev->nthreads;
+	double *y = ev->y;
+	double *exp_mu = family == 2 ? REAL(r_exp_mu) : nullptr;
+
+	int K = Rf_isNull(jacob) ? 0 : Rf_length(jacob) / n;
+	double *J = K > 0 ? REAL(jacob) : nullptr;
+
+	bool isDeriv = Rf_length(dxi_dbeta) > 1;
+	double *D = isDeriv ? REAL(dxi_dbeta) : nullptr;
+	double *d2 = REAL(ll_d2);
+
+	bool isNegbin = family == 2;
+	bool isDerivOther = isNegbin && Rf_length(dxi_dother) > 1;
+	double *dx = isNegbin ? REAL(ll_dx_dother) : nullptr;
+	double *dxo = isDerivOther ? REAL(dxi_dother) : nullptr;
+
+	// values: K*K (upper triangle only is filled) + negbin: K cross derivatives + theta
+	int n_values = K * K + (isNegbin ? K + 1 : 0);
+	int stride = femlm_stride(n_values);
+	vector<double> all_sums(nthreads * stride, 0);
+
+	#pragma omp parallel num_threads(nthreads)
+	{
+		double *my_sum = all_sums.data() + omp_get_thread_num() * stride;
+		double *my_theta_L = my_sum + K * K;
+		vector<double> row(K);
+
+		#pragma omp for schedule(static)
+		for(int i=0 ; i<n ; ++i){
+
+			for(int k=0 ; k<K ; ++k){
+				row[k] = isDeriv ? J[(size_t)k * n + i] + D[(size_t)k * n + i] : J[(size_t)k * n + i];
+			}
+
+			double d2_i = d2[i];
+			for(int k_row=0 ; k_row<K ; ++k_row){
+				double value = row[k_row] * d2_i;
+				double *my_col = my_sum + k_row * K;
+				for(int k_col=k_row ; k_col<K ; ++k_col){
+					my_col[k_col] += value * row[k_col];
+				}
+			}
+
+			if(isNegbin){
+				double dxo_i = isDerivOther ? dxo[i] : 0;
+				double value = dxo_i * d2_i + dx[i];
+				for(int k=0 ; k<K ; ++k){
+					my_theta_L[k] += row[k] * value;
+				}
+
+				double a = theta / exp_mu[i] + 1;
+				double b = theta + exp_mu[i];
+				// + trigamma(theta + y), summed later
+				my_theta_L[K] += dxo_i * dxo_i * d2_i + 2 * dxo_i * dx[i] - 1 / b + y[i] / (b * b) - 1 / (a * b);
+			}
+		}
+	}
+
+	vector<double> sums(n_values);
+	femlm_reduce(all_sums, nthreads, n_values, sums.data());
+
+	int n_coef = K + isNegbin;
+	NumericMatrix res(n_coef, n_coef);
+
+	for(int k_row=0 ; k_row<K ; ++k_row){
+		for(int k_col=k_row ; k_col<K ; ++k_col){
+			res(k_row, k_col) = res(k_col, k_row) = sums[k_row * K + k_col];
+		}
+	}
+
+	if(isNegbin){
+		double *theta_L = sums.data() + K * K;
+		for(int k=0 ; k<K ; ++k){
+			res(k, K) = res(K, k) = theta_L[k];
+		}
+
+		res(K, K) = theta_L[K] + negbin_sum_y(ev, theta, 2) + n * (- R::trigamma(theta) + 1 / theta);
+	}
+
+	return res;
+}
+
+//
+// Negbin: theta for a given mu
+//
+
+void negbin_theta_pass(FEMLM_EVAL *ev, double *mu, double *exp_mu, double theta,
+                       double &ll, double &score, double &hess){
+	// ll and its first two derivatives wrt theta, mu fixed
+
+	int n = ev->n;
+	double *y = ev->y;
+
+	double ll_tmp = 0, score_tmp = 0, hess_tmp = 0;
+
+	#pragma omp parallel for num_threads(ev->nthreads) reduction(+:ll_tmp,score_tmp,hess_tmp)
+	for(int i=0 ; i<n ; ++i){
+		double log_theta_exp = log_a_exp(theta, mu[i], exp_mu[i]);
+		double a = theta / exp_mu[i] + 1;
+		double b = theta + exp_mu[i];
+
+		ll_tmp += y[i] * mu[i] - (theta + y[i]) * log_theta_exp;
+		score_tmp += - log_theta_exp - (theta + y[i]) / b;
+		hess_tmp += - 1 / b + y[i] / (b * b) - 1 / (a * b);
+	}
+
+	ll = ll_tmp + negbin_sum_y(ev, theta, 0) - ev->sum_lfact + n * (- R::lgammafn(theta) + theta * log(theta));
+	score = score_tmp + negbin_sum_y(ev, theta, 1) + n * (- R::digamma(theta) + log(theta) + 1);
+	hess = hess_tmp + negbin_sum_y(ev, theta, 2) + n * (- R::trigamma(theta) + 1 / theta);
+}
+
+// [[Rcpp::export]]
+List cpp_negbin_theta(SEXP eval, SEXP r_mu, SEXP r_exp_mu, double theta_init,
+                      double lower, double upper, double tol, int iter_max){
+	// Maximizes the ll wrt theta in [lower, upper], mu being fixed
+	// Newton steps (in log scale), kept within the bracket given by the sign of the score
+	// (when the step goes out of the bracket: bisection, in log scale)
+
+	FEMLM_EVAL *ev = femlm_eval_get(eval);
+	if(ev->family != 2){
+		stop("cpp_negbin_theta: the family must be negbin.");
+	}
+
+	double *mu = REAL(r_mu);
+	double *exp_mu = REAL(r_exp_mu);
+
+	double theta = theta_init < lower ? lower : (theta_init > upper ? upper : theta_init);
+	double lo = lower, hi = upper;
+	double ll, score, hess;
+	// theta_eval: value at which ll is evaluated
+	double theta_eval = theta;
+	bool conv = false;
+
+	int iter = 0;
+	while(!conv && iter < iter_max){
+		++iter;
+
+		negbin_theta_pass(ev, mu, exp_mu, theta, ll, score, hess);
+		theta_eval = theta;
+
+		// at the bounds
+		if((theta == lower && score <= 0) || (theta == upper && score >= 0)){
+			conv = true;
+			break;
+		}
+
+		if(score > 0){
+			lo = theta;
+		} else {
+			hi = theta;
+		}
+
+		// Newton step on log(theta) (the ll is much closer to a quadratic in log(theta))
+		double score_log = theta * score;
+		double hess_log = theta * theta * hess + theta * score;
+		double theta_new = hess_log < 0 ? theta * exp(- score_log / hess_log) : lo;
+		if(!(theta_new > lo && theta_new < hi)){
+			theta_new = sqrt(lo * hi);
+		}
+
+		// convergence: small step, or small expected increase of the ll (which is also
+		// the level of noise of the score for large theta)
+		conv = fabs(theta_new - theta) < tol * theta;
+		if(hess_log < 0 && - score_log * score_log / hess_log / 2 < tol * (0.1 + fabs(ll))){
+			conv = true;
+		}
+		theta = theta_new;
+	}
+
+	if(theta != theta_eval){
+		// ll at the final value
+		negbin_theta_pass(ev, mu, exp_mu, theta, ll, score, hess);
+	}
+
+	List res;
+	res["theta"] = theta;
+	res["ll"] = ll;
+	res["score"] = score;
+	res["iter"] = iter;
+	res["conv"] = conv;
+
+	return res;
+}
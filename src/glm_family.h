@@ -0,0 +1,153 @@
+/************************************************************
+ * ___________________                                      *
+ * || GLM families ||                                      *
+ * -------------------                                      *
+ *                                                          *
+ * Scalar functions of the GLM families handled in C++      *
+ * (used by the C++ IRLS, see cpp_irls).                    *
+ *                                                          *
+ * They are identical to the functions of the family        *
+ * objects of R (stats::family), except for poisson and     *
+ * logit for which they are identical to the (faster)       *
+ * custom versions used in feglm (see fixest_env).          *
+ *                                                          *
+ * Each family is a struct with static functions so that    *
+ * the loops can be specialized at compile time.            *
+ *                                                          *
+ ***********************************************************/
+
+#ifndef FIXEST_GLM_FAMILY_H
+#define FIXEST_GLM_FAMILY_H
+
+#include <Rcpp.h>
+#include <math.h>
+#include <cmath>
+#include <Rmath.h>
+#include "fast_math.h"
+
+// family identifiers (see the R function irls_family_id)
+const int GLM_POISSON = 1;
+const int GLM_LOGIT = 2;
+const int GLM_PROBIT = 3;
+const int GLM_GAUSSIAN = 4;
+const int GLM_GAMMA = 5;
+
+inline double poisson_linkinv(double x){
+    return x < -36 ? DOUBLE_EPS : fm_exp(x);
+}
+
+inline double logit_linkinv(double x){
+    return x < -30 ? DOUBLE_EPS : (x > 30) ? 1-DOUBLE_EPS : 1 / (1 + 1 / fm_exp(x));
+}
+
+inline double logit_mueta(double x){
+    if(fabs(x) > 30){
+        return DOUBLE_EPS;
+    } else {
+        double exp_x = fm_exp(x);
+        return (1 / ((1 + 1 / exp_x) * (1 + exp_x)));
+    }
+}
+
+inline double binomial_devresid(double y, double mu, double wt){
+	if(y == 1){
+		return - 2 * fm_log(mu) * wt;
+	} else if(y == 0){
+		return - 2 * fm_log(1 - mu) * wt;
+	}
+
+	return 2 * wt * (y*fm_log(y/mu) + (1 - y)*fm_log((1 - y)/(1 - mu)));
+}
+
+// validmu/valideta: whether the value is valid (the vector is valid if all its values are)
+
+struct FAM_POISSON{
+	static double linkinv(double eta){ return poisson_linkinv(eta); }
+	static double mu_eta(double mu, double){ return mu; }
+	static double variance(double mu){ return mu; }
+	static double devresid(double y, double mu, double eta, double wt){
+		// 2 * wt * (y * log(y/mu) - (y - mu)), with log(mu) = eta (like in fixest_env)
+		return y > 0 ? 2 * wt * (y * fm_log(y) - y - y * eta + mu) : 2 * wt * mu;
+	}
+	static bool validmu(double mu){ return !(std::isinf(mu) || mu <= 0); }
+	static bool valideta(double){ return true; }
+};
+
+struct FAM_LOGIT{
+	static double linkinv(double eta){ return logit_linkinv(eta); }
+	static double mu_eta(double, double eta){ return logit_mueta(eta); }
+	static double variance(double mu){ return mu * (1 - mu); }
+	static double devresid(double y, double mu, double, double wt){ return binomial_devresid(y, mu, wt); }
+	static bool validmu(double mu){ return std::isfinite(mu) && mu > 0 && mu < 1; }
+	static bool valideta(double){ return true; }
+};
+
+struct FAM_PROBIT{
+	// -qnorm(.Machine$double.eps)
+	static double thresh(){ return 8.125890664701906; }
+	static double linkinv(double eta){
+		double th = thresh();
+		double x = eta < -th ? -th : (eta > th ? th : eta);
+		return R::pnorm(x, 0, 1, 1, 0);
+	}
+	static double mu_eta(double, double eta){
+		double value = R::dnorm(eta, 0, 1, 0);
+		return value > DOUBLE_EPS ? value : DOUBLE_EPS;
+	}
+	static double variance(double mu){ return mu * (1 - mu); }
+	static double devresid(double y, double mu, double, double wt){ return binomial_devresid(y, mu, wt); }
+	static bool validmu(double mu){ return std::isfinite(mu) && mu > 0 && mu < 1; }
+	static bool valideta(double){ return true; }
+};
+
+struct FAM_GAUSSIAN{
+	static double linkinv(double eta){ return eta; }
+	static double mu_eta(double, double){ return 1; }
+	static double variance(double){ return 1; }
+	static double devresid(double y, double mu, double, double wt){ return wt * (y - mu) * (y - mu); }
+	static bool validmu(double){ return true; }
+	static bool valideta(double){ return true; }
+};
+
+struct FAM_GAMMA{
+	// inverse link
+	static double linkinv(double eta){ return 1 / eta; }
+	static double mu_eta(double, double eta){ return -1 / (eta * eta); }
+	static double variance(double mu){ return mu * mu; }
+	static double devresid(double y, double mu, double, double wt){
+		return -2 * wt * ((y == 0 ? 0 : fm_log(y / mu)) - (y - mu) / mu);
+	}
+	static bool validmu(double mu){ return std::isfinite(mu) && mu > 0; }
+	static bool valideta(double eta){ return std::isfinite(eta) && eta != 0; }
+};
+
+//
+// Fused pass (defined in parallel_funs.cpp)
+//
+
+// Everything the IRLS needs after an update of the linear predictor,
+// computed in a single pass over the observations
+struct GLM_PASS{
+	// sum of the deviance residuals
+	double dev;
+	// validmu(mu), valideta(eta) and valideta(eta - offset)
+	bool valid_mu;
+	bool valid_eta;
+	bool valid_fitted;
+	// controls of V(mu) and d(mu)/d(eta)
+	bool any_na_var;
+	bool any_0_var;
+	bool any_na_mueta;
+	// number of null working weights
+	int n_0w;
+};
+
+// update_mu: if true, eta = fitted + offset and mu = linkinv(eta) are computed first
+//            otherwise eta and mu are taken as given (fitted is not used)
+// offset/weights: nullptr if absent
+// outputs: z, the working response (w/t offset), and w, the working weights
+void glm_fused_pass(int family, int n, const double *y, const double *fitted, const double *offset,
+                    const double *weights, double *eta, double *mu, double *z, double *w,
+                    bool update_mu, GLM_PASS &pass, int nthreads);
+
+#endif
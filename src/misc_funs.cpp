@@ -23,6 +23,7 @@
 #include <math.h>
 #include <vector>
 #include <stdio.h>
+#include "fast_math.h"
 
 using namespace Rcpp;
 using namespace std;
@@ -52,7 +53,7 @@ NumericVector cpp_log_a_exp(double a, NumericVector mu, NumericVector exp_mu){
 
 	for(int i=0 ; i<n ; i++){
 		if(mu[i] < 200){
-			res[i] = log(a + exp_mu[i]);
+			res[i] = fm_log(a + exp_mu[i]);
 		} else {
 			res[i] = mu[i];
 		}
@@ -864,38 +865,24 @@ List cpp_find_duplicates(IntegerVector id, IntegerVector time){
 
 // [[Rcpp::export]]
 int cpp_pgcd(IntegerVector x){
-    // quick and dirty, but does not matter
+    // greatest common divisor of the (positive) time steps, Euclid's algorithm
+    // no step (a single period): 1
 
     int n = x.length();
+    int pgcd = 0;
 
-    if(n == 1){
-        return(x[0]);
-    }
-
-    bool ok = false;
-    int pgcd = x[0];
-
-    // the min
-    for(int i=1 ; i<n ; ++i){
-        if(pgcd > x[i]){
-            pgcd = x[i];
+    for(int i=0 ; i<n ; ++i){
+        int a = x[i] < 0 ? -x[i] : x[i];
+        while(a != 0){
+            int r = pgcd % a;
+            pgcd = a;
+            a = r;
         }
-    }
 
-    // the denom
-    while(!ok && pgcd > 1){
-        ok = true;
-        for(int i=0 ; i<n ; ++i){
-            if(x[i] % pgcd != 0){
-                pgcd--;
-                ok = false;
-                break;
-            }
-        }
+        if(pgcd == 1) break;
     }
 
-
-    return pgcd;
+    return pgcd == 0 ? 1 : pgcd;
 }
 
 // [[Rcpp::export]]
@@ -24,6 +24,9 @@
 #include <cmath>
 #include <stdio.h>
 #include <Rmath.h>
+#include <chrono>
+#include "fast_math.h"
+#include "glm_family.h"
 
 using namespace Rcpp;
 
@@ -31,6 +34,19 @@ using namespace Rcpp;
 
 // This file contains misc femlm functions parallelized with the omp library
 
+// Math accuracy: if true, the fast versions of exp/log are used (see fast_math.h)
+bool fixest_fast_math = false;
+
+// [[Rcpp::export]]
+void cpp_set_fast_math(bool fast){
+	fixest_fast_math = fast;
+}
+
+// [[Rcpp::export]]
+bool cpp_get_fast_math(){
+	return fixest_fast_math;
+}
+
 // [[Rcpp::export]]
 NumericVector cpppar_exp(NumericVector x, int nthreads){
 	// parallel exponentiation using omp
@@ -38,6 +54,11 @@ NumericVector cpppar_exp(NumericVector x, int nthreads){
 	int n = x.length();
 	NumericVector res(n);
 
+	if(fixest_fast_math){
+		fast_exp_vec(n, REAL(x), REAL(res), nthreads);
+		return(res);
+	}
+
 	#pragma omp parallel for num_threads(nthreads)
 	for(int i = 0 ; i < n ; ++i) {
 		res[i] = exp(x[i]);
@@ -53,6 +74,11 @@ NumericVector cpppar_log(NumericVector x, int nthreads){
 	int n = x.length();
 	NumericVector res(n);
 
+	if(fixest_fast_math){
+		fast_log_vec(n, REAL(x), REAL(res), nthreads);
+		return(res);
+	}
+
 	#pragma omp parallel for num_threads(nthreads)
 	for(int i = 0 ; i < n ; ++i) {
 		res[i] = log(x[i]);
@@ -61,6 +87,80 @@ NumericVector cpppar_log(NumericVector x, int nthreads){
 	return(res);
 }
 
+// [[Rcpp::export]]
+List cpp_benchmark_fast_math(int n, int nthreads){
+	// Compares the fast exp/log to libm on the typical ranges of the estimations:
+	// - exp: linear predictors in [-30, 30] and in [-700, 700]
+	// - log: values in [1e-10, 1e10] and in [0.5, 2]
+	// returns the time (in s) of each method and the max error in ulp
+
+	int n_ranges = 4;
+	double range_min[] = {-30, -700, -10, 0.5};
+	double range_max[] = {30, 700, 10, 2};
+	bool is_exp[] = {true, true, false, false};
+
+	CharacterVector fun(n_ranges), range(n_ranges);
+	NumericVector time_libm(n_ranges), time_fast(n_ranges), max_ulp(n_ranges);
+
+	std::vector<double> x(n), res_libm(n), res_fast(n);
+
+	for(int r=0 ; r<n_ranges ; ++r){
+
+		// the values: a regular grid (the log range is on the log10 scale)
+		for(int i=0 ; i<n ; ++i){
+			double value = range_min[r] + (range_max[r] - range_min[r]) * i / (n - 1.0);
+			x[i] = (is_exp[r] || r == 3) ? value : pow(10, value);
+		}
+
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		if(is_exp[r]){
+			#pragma omp parallel for num_threads(nthreads)
+			for(int i=0 ; i<n ; ++i){
+				res_libm[i] = exp(x[i]);
+			}
+		} else {
+			#pragma omp parallel for num_threads(nthreads)
+			for(int i=0 ; i<n ; ++i){
+				res_libm[i] = log(x[i]);
+			}
+		}
+
+		std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+		if(is_exp[r]){
+			fast_exp_vec(n, x.data(), res_fast.data(), nthreads);
+		} else {
+			fast_log_vec(n, x.data(), res_fast.data(), nthreads);
+		}
+		std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+		// error in ulp of the libm result
+		double ulp_max = 0;
+		for(int i=0 ; i<n ; ++i){
+			double value = fabs(res_libm[i]);
+			double ulp = nextafter(value, INFINITY) - value;
+			double err = fabs(res_fast[i] - res_libm[i]) / ulp;
+			if(err > ulp_max) ulp_max = err;
+		}
+
+		fun[r] = is_exp[r] ? "exp" : "log";
+		char buffer[50];
+		snprintf(buffer, 50, r == 2 ? "[1e%g, 1e%g]" : "[%g, %g]", range_min[r], range_max[r]);
+		range[r] = buffer;
+		time_libm[r] = std::chrono::duration<double>(t1 - t0).count();
+		time_fast[r] = std::chrono::duration<double>(t2 - t1).count();
+		max_ulp[r] = ulp_max;
+	}
+
+	List res;
+	res["fun"] = fun;
+	res["range"] = range;
+	res["time_libm"] = time_libm;
+	res["time_fast"] = time_fast;
+	res["max_ulp"] = max_ulp;
+
+	return(res);
+}
+
 // [[Rcpp::export]]
 NumericVector cpppar_log_a_exp(int nthreads, double a, NumericVector mu, NumericVector exp_mu){
 	// faster this way
@@ -71,7 +171,7 @@ NumericVector cpppar_log_a_exp(int nthreads, double a, NumericVector mu, Numeric
 	#pragma omp parallel for num_threads(nthreads)
 	for(int i=0 ; i<n ; ++i) {
 		if(mu[i] < 200){
-			res[i] = log(a + exp_mu[i]);
+			res[i] = fm_log(a + exp_mu[i]);
 		} else {
 			res[i] = mu[i];
 		}
@@ -125,10 +225,6 @@ NumericVector cpppar_trigamma(NumericVector x, int nthreads){
 	return(res);
 }
 
-inline double poisson_linkinv(double x){
-    return x < -36 ? DOUBLE_EPS : exp(x);
-}
-
 // [[Rcpp::export]]
 NumericVector cpppar_poisson_linkinv(NumericVector x, int nthreads){
 
@@ -173,16 +269,12 @@ NumericVector cpppar_logit_linkfun(NumericVector x, int nthreads){
 	#pragma omp parallel for num_threads(nthreads)
 	for(int i = 0 ; i < n ; ++i) {
 	    double x_tmp = x[i];
-		res[i] = log(x_tmp) - log(1 - x_tmp);
+		res[i] = fm_log(x_tmp) - fm_log(1 - x_tmp);
 	}
 
 	return(res);
 }
 
-inline double logit_linkinv(double x){
-    return x < -30 ? DOUBLE_EPS : (x > 30) ? 1-DOUBLE_EPS : 1 / (1 + 1 / exp(x));
-}
-
 // [[Rcpp::export]]
 NumericVector cpppar_logit_linkinv(NumericVector x, int nthreads){
 	// parallel trigamma using omp
@@ -199,15 +291,6 @@ NumericVector cpppar_logit_linkinv(NumericVector x, int nthreads){
 	return(res);
 }
 
-inline double logit_mueta(double x){
-    if(fabs(x) > 30){
-        return DOUBLE_EPS;
-    } else {
-        double exp_x = exp(x);
-        return (1 / ((1 + 1 / exp_x) * (1 + exp_x)));
-    }
-}
-
 // [[Rcpp::export]]
 NumericVector cpppar_logit_mueta(NumericVector x, int nthreads){
 	// parallel trigamma using omp
@@ -236,27 +319,27 @@ NumericVector cpppar_logit_devresids(NumericVector y, NumericVector mu, NumericV
 		#pragma omp parallel for num_threads(nthreads)
 		for(int i = 0 ; i < n ; ++i) {
 			if(y[i] == 1){
-				res[i] = - 2 * log(mu[i]) * wt[i];
+				res[i] = - 2 * fm_log(mu[i]) * wt[i];
 			} else if(y[i] == 0){
-				res[i] = - 2 * log(1 - mu[i]) * wt[i];
+				res[i] = - 2 * fm_log(1 - mu[i]) * wt[i];
 			} else {
 			    double y_tmp = y[i];
 			    double mu_tmp = mu[i];
-				res[i] = 2 * wt[i] * (y_tmp*log(y_tmp/mu_tmp) + (1 - y_tmp)*log((1 - y_tmp)/(1 - mu_tmp)));
+				res[i] = 2 * wt[i] * (y_tmp*fm_log(y_tmp/mu_tmp) + (1 - y_tmp)*fm_log((1 - y_tmp)/(1 - mu_tmp)));
 			}
 		}
 	} else {
 		#pragma omp parallel for num_threads(nthreads)
 		for(int i = 0 ; i < n ; ++i) {
 			if(y[i] == 1){
-				res[i] = - 2 * log(mu[i]);
+				res[i] = - 2 * fm_log(mu[i]);
 			} else if(y[i] == 0){
-				res[i] = - 2 * log(1 - mu[i]);
+				res[i] = - 2 * fm_log(1 - mu[i]);
 			} else {
 			    double y_tmp = y[i];
 			    double mu_tmp = mu[i];
 				// res[i] = 2 * (y[i]*log(y[i]/mu[i]) + (1 - y[i])*log((1 - y[i])/(1 - mu[i])));
-				res[i] = 2 * (y_tmp*log(y_tmp/mu_tmp) + (1 - y_tmp)*log((1 - y_tmp)/(1 - mu_tmp)));
+				res[i] = 2 * (y_tmp*fm_log(y_tmp/mu_tmp) + (1 - y_tmp)*fm_log((1 - y_tmp)/(1 - mu_tmp)));
 			}
 		}
 	}
@@ -266,6 +349,86 @@ NumericVector cpppar_logit_devresids(NumericVector y, NumericVector mu, NumericV
 }
 
 
+//
+// Fused GLM pass
+//
+
+// One pass over the observations replacing the separate calls to linkinv, mu.eta,
+// variance, dev.resids, validmu/valideta and the formation of z and w.
+// The family is a template parameter so that each family gets its own loop.
+
+template<class FAM>
+void glm_fused_pass_tpl(int n, const double *y, const double *fitted, const double *offset,
+                        const double *weights, double *eta, double *mu, double *z, double *w,
+                        bool update_mu, GLM_PASS &pass, int nthreads){
+
+	bool isOffset = offset != nullptr;
+	bool isWeight = weights != nullptr;
+
+	double dev = 0;
+	bool valid_mu = true, valid_eta = true, valid_fitted = true;
+	bool any_na_var = false, any_0_var = false, any_na_mueta = false;
+	int n_0w = 0;
+
+	#pragma omp parallel for num_threads(nthreads) reduction(+:dev,n_0w) reduction(&&:valid_mu,valid_eta,valid_fitted) reduction(||:any_na_var,any_0_var,any_na_mueta)
+	for(int i=0 ; i<n ; ++i){
+
+		if(update_mu){
+			eta[i] = isOffset ? fitted[i] + offset[i] : fitted[i];
+			mu[i] = FAM::linkinv(eta[i]);
+			valid_fitted = valid_fitted && FAM::valideta(fitted[i]);
+		}
+
+		double eta_i = eta[i], mu_i = mu[i];
+		double wt = isWeight ? weights[i] : 1;
+
+		dev += FAM::devresid(y[i], mu_i, eta_i, wt);
+		valid_mu = valid_mu && FAM::validmu(mu_i);
+		valid_eta = valid_eta && FAM::valideta(eta_i);
+
+		// working response and weights
+		double mu_eta = FAM::mu_eta(mu_i, eta_i);
+		double var_mu = FAM::variance(mu_i);
+
+		any_na_var = any_na_var || std::isnan(var_mu);
+		any_0_var = any_0_var || var_mu == 0;
+		any_na_mueta = any_na_mueta || std::isnan(mu_eta);
+
+		z[i] = (isOffset ? eta_i - offset[i] : eta_i) + (y[i] - mu_i) / mu_eta;
+		w[i] = wt * (mu_eta * mu_eta) / var_mu;
+		n_0w += w[i] == 0;
+	}
+
+	pass.dev = dev;
+	pass.valid_mu = valid_mu;
+	pass.valid_eta = valid_eta;
+	pass.valid_fitted = update_mu ? valid_fitted : true;
+	pass.any_na_var = any_na_var;
+	pass.any_0_var = any_0_var;
+	pass.any_na_mueta = any_na_mueta;
+	pass.n_0w = n_0w;
+}
+
+void glm_fused_pass(int family, int n, const double *y, const double *fitted, const double *offset,
+                    const double *weights, double *eta, double *mu, double *z, double *w,
+                    bool update_mu, GLM_PASS &pass, int nthreads){
+
+	if(family == GLM_POISSON){
+		glm_fused_pass_tpl<FAM_POISSON>(n, y, fitted, offset, weights, eta, mu, z, w, update_mu, pass, nthreads);
+	} else if(family == GLM_LOGIT){
+		glm_fused_pass_tpl<FAM_LOGIT>(n, y, fitted, offset, weights, eta, mu, z, w, update_mu, pass, nthreads);
+	} else if(family == GLM_PROBIT){
+		glm_fused_pass_tpl<FAM_PROBIT>(n, y, fitted, offset, weights, eta, mu, z, w, update_mu, pass, nthreads);
+	} else if(family == GLM_GAUSSIAN){
+		glm_fused_pass_tpl<FAM_GAUSSIAN>(n, y, fitted, offset, weights, eta, mu, z, w, update_mu, pass, nthreads);
+	} else if(family == GLM_GAMMA){
+		glm_fused_pass_tpl<FAM_GAMMA>(n, y, fitted, offset, weights, eta, mu, z, w, update_mu, pass, nthreads);
+	} else {
+		stop("glm_fused_pass: unknown family.");
+	}
+}
+
+
 // [[Rcpp::export]]
 NumericMatrix cpppar_crossprod(NumericMatrix X, NumericVector w, int nthreads){
 
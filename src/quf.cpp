@@ -25,7 +25,9 @@
  *  very simple and very fast: we just have to set a lookup table.    *
  *  For integers of large range, setting up a large                   *
  *  lookup table can be too costly, therefore I sort the vector       *
- *  first and then create the new values.                             *
+ *  first and then create the new values. When the values are         *
+ *  clustered, a lookup table cut in pages (only the pages in use     *
+ *  are allocated) is used instead.                                   *
  *  The process is similar for doubles: first sort, then get the      *
  *  new values.                                                       *
  *  Finally for string vectors, I use R's feature of stocking         *
@@ -44,16 +46,34 @@
  *  the system is of no importantce: whatever the order of bytes      *
  *  on which we sort, we obtain what we want.                         *
  *                                                                    *
+ *  For large vectors, the radix sort is multi-threaded: each thread  *
+ *  counts and scatters its own chunk of the data.                    *
+ *                                                                    *
+ *  For doubles and strings, when the number of unique values is not  *
+ *  too large, a hash table is used instead of the sort.              *
+ *                                                                    *
+ *  Several vectors can be qufed jointly (e.g. to interact fixed-     *
+ *  effects): they are combined by pairs of ids, without strings.     *
+ *                                                                    *
+ *  The radix sort is also used to build the index of panels (sort    *
+ *  by id and time), on which the lags and leads are computed.        *
+ *                                                                    *
  *                                                                    *
  *********************************************************************/
 
 #include <Rcpp.h>
 #include <vector>
+#include <algorithm>
+#include <climits>
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
 
 using namespace Rcpp;
 using std::vector;
 
 // [[Rcpp::plugins(cpp11)]]
+// [[Rcpp::plugins(openmp)]]
 
 
 
@@ -65,137 +85,399 @@ inline unsigned long long float_to_ull(void *u, int i) {
     return (u_ull ^ mask);
 }
 
-inline double ull_to_float(unsigned long long u_ull) {
-    unsigned long long mask = ((u_ull >> 63) - 1) | 0x8000000000000000;
-    unsigned long long res_ull = u_ull ^ mask;
-    unsigned long long *pres_ull = &res_ull;
-    double *pres = reinterpret_cast<double*>(pres_ull);
-    double res = *pres;
-    return res;
+//
+// Radix sort engine
+//
+
+// LSD radix sort of the keys + the order of the observations.
+// Only the bits that vary across the data are sorted on (e.g. doubles with round values
+// have constant low bits). The digits are at most 11 bits wide, so that the count table
+// of each pass stays in the L1 cache: 3 passes for 32 bits keys, 6 passes for 64 bits keys
+// (8 bits digits for small data, where the cost of the tables would dominate).
+// Multi-threaded: the data is cut into one chunk per thread. For each digit, each thread
+// counts its chunk, then the offsets are cumulated by value of the digit and by chunk,
+// and each thread scatters its own chunk. Thread t writes the values of digit d right after
+// those of the threads 0 to t-1: the sort is stable.
+// The digits that are constant across the data are skipped.
+//
+// For large data, each LSD pass scatters the full data out of the cache. Instead we first
+// partition the data on the highest digit (MSD), then each partition, which now fits in
+// the cache, is sorted with the LSD sort. The partitions are sorted in parallel.
+
+// below this number of observations, we stay single threaded
+const int QUF_PAR_MIN = 100000;
+// below this number of observations, the digits are 8 bits wide
+const int QUF_RADIX_SMALL = 1 << 14;
+// above this number of observations, MSD partitioning first
+const int QUF_MSD_MIN = 1 << 18;
+const int QUF_DIGIT_BITS = 11;
+
+template<typename T>
+void radix_bits(int n, const T *x, int nthreads, int &bit_min, int &n_bits){
+    // the bits that vary across the data: n_bits bits starting from bit_min (n_bits = 0: constant)
+
+    if(n < QUF_PAR_MIN) nthreads = 1;
+
+    T x_first = x[0];
+    vector<T> all_diff(nthreads, 0);
+    #pragma omp parallel for num_threads(nthreads)
+    for(int t=0 ; t<nthreads ; ++t){
+        int start = static_cast<int>((static_cast<long long>(n) * t) / nthreads);
+        int end = static_cast<int>((static_cast<long long>(n) * (t + 1)) / nthreads);
+        T diff = 0;
+        for(int i=start ; i<end ; ++i){
+            diff |= x[i] ^ x_first;
+        }
+        all_diff[t] = diff;
+    }
+
+    T diff = 0;
+    for(int t=0 ; t<nthreads ; ++t) diff |= all_diff[t];
+
+    bit_min = 0;
+    n_bits = 0;
+    if(diff == 0) return;
+
+    while(!((diff >> bit_min) & 1)) ++bit_min;
+    int bit_max = 8 * sizeof(T) - 1;
+    while(!((diff >> bit_max) & 1)) --bit_max;
+    n_bits = bit_max - bit_min + 1;
 }
 
-void quf_double(vector<int> &x_uf, void *px, vector<double> &x_unik, bool is_string = false){
+template<typename T>
+void radix_sort_lsd(int n, T *&x_read, T *&x_write, int *&o_read, int *&o_write, int nthreads){
+    // x_read/o_read: keys and order, x_write/o_write: buffers
+    // on exit, x_read/o_read point to the sorted data (the pointers are swapped at each pass)
 
-    // x_uf: x unclassed factor
-    // px: pointer to x vector (R vector) -- READ ONLY!!!
-    // x_unik: empty vector
-    // px: either double or ULL (in case of strings)
+    if(n < QUF_PAR_MIN) nthreads = 1;
 
-    int n = x_uf.size();
+    int bit_min, n_bits;
+    radix_bits(n, x_read, nthreads, bit_min, n_bits);
+    if(n_bits == 0) return;
 
-    double *px_dble = (double *)px;
-    unsigned long long *px_ull = (unsigned long long *)px;
+    // digits of equal width, at most max_bits
+    int max_bits = n < QUF_RADIX_SMALL ? 8 : QUF_DIGIT_BITS;
+    int n_pass = (n_bits + max_bits - 1) / max_bits;
+    int digit_bits = (n_bits + n_pass - 1) / n_pass;
+    int n_buckets = 1 << digit_bits;
+    T mask = static_cast<T>(n_buckets - 1);
 
-    // variables
-    unsigned long long x_ull_current = 0;
-    // char: 2 octets: 0-255
-    // one double is made of 8 char
-    unsigned char x_char = 0;
-    vector<unsigned long long> x_ulong(is_string ? 1 : n), x_tmp(n);
+    int n_chunks = nthreads;
+    vector<int> bounds(n_chunks + 1);
+    for(int t=0 ; t<=n_chunks ; ++t){
+        bounds[t] = static_cast<int>((static_cast<long long>(n) * t) / n_chunks);
+    }
 
-    // in case the data is string, we use px as the x_ulong
-    unsigned long long *px_ulong = is_string ? px_ull : x_ulong.data();
+    // 1) Counting, all digits at once
+    vector<int> radix_table(n_chunks * n_pass * n_buckets, 0);
+
+    #pragma omp parallel for num_threads(nthreads)
+    for(int t=0 ; t<n_chunks ; ++t){
+        int *my_table = radix_table.data() + t * n_pass * n_buckets;
+        T *my_x = x_read;
+        for(int i=bounds[t] ; i<bounds[t + 1] ; ++i){
+            T xi = my_x[i] >> bit_min;
+            for(int p=0 ; p<n_pass ; ++p){
+                ++my_table[p * n_buckets + ((xi >> digit_bits*p) & mask)];
+            }
+        }
+    }
 
+    // 1') skipping
+    vector<bool> skip_flag(n_pass);
+    T x_first = x_read[0] >> bit_min;
+    for(int p=0 ; p<n_pass ; ++p){
+        int d = (x_first >> digit_bits*p) & mask;
+        int total = 0;
+        for(int t=0 ; t<n_chunks ; ++t){
+            total += radix_table[(t * n_pass + p) * n_buckets + d];
+        }
+        skip_flag[p] = total == n;
+    }
 
-    // radix array
-    int radix_table[8][256] = { {0} };
+    // 2) Sorting
+    vector<int> offset(n_chunks * n_buckets);
+    bool first_pass = true;
+    for(int p=0 ; p<n_pass ; ++p){
+        if(skip_flag[p]) continue;
+
+        int shift = bit_min + digit_bits*p;
+
+        if(!first_pass && n_chunks > 1){
+            // the chunks have changed => recount (not needed with one chunk)
+            #pragma omp parallel for num_threads(nthreads)
+            for(int t=0 ; t<n_chunks ; ++t){
+                int *my_table = radix_table.data() + (t * n_pass + p) * n_buckets;
+                for(int d=0 ; d<n_buckets ; ++d) my_table[d] = 0;
+                T *my_x = x_read;
+                for(int i=bounds[t] ; i<bounds[t + 1] ; ++i){
+                    ++my_table[(my_x[i] >> shift) & mask];
+                }
+            }
+        }
+        first_pass = false;
+
+        // offsets: by value of the digit, then by chunk
+        int cum = 0;
+        for(int d=0 ; d<n_buckets ; ++d){
+            for(int t=0 ; t<n_chunks ; ++t){
+                offset[t * n_buckets + d] = cum;
+                cum += radix_table[(t * n_pass + p) * n_buckets + d];
+            }
+        }
 
-    // 1) Counting
-    for(int i=0 ; i<n ; ++i){
+        #pragma omp parallel for num_threads(nthreads)
+        for(int t=0 ; t<n_chunks ; ++t){
+            int *my_offset = offset.data() + t * n_buckets;
+            T *my_x_read = x_read, *my_x_write = x_write;
+            int *my_o_read = o_read, *my_o_write = o_write;
+            for(int i=bounds[t] ; i<bounds[t + 1] ; ++i){
+                int index = my_offset[(my_x_read[i] >> shift) & mask]++;
+                my_x_write[index] = my_x_read[i];
+                my_o_write[index] = my_o_read[i];
+            }
+        }
 
-        if(is_string){
-            x_ull_current = px_ull[i];
-        } else {
-            // we change x double into ulong after flipping to keep order
-            x_ull_current = float_to_ull(px_dble, i);
-            x_ulong[i] = x_ull_current;
+        std::swap(x_read, x_write);
+        std::swap(o_read, o_write);
+    }
+}
+
+template<typename T>
+void radix_sort(int n, T *&x_read, T *&x_write, int *&o_read, int *&o_write, int nthreads){
+    // same arguments as radix_sort_lsd
+    // MSD partitioning on the highest digit, then LSD sort of each partition
+
+    if(n < QUF_MSD_MIN){
+        radix_sort_lsd(n, x_read, x_write, o_read, o_write, nthreads);
+        return;
+    }
+
+    int bit_min, n_bits;
+    radix_bits(n, x_read, nthreads, bit_min, n_bits);
+
+    if(n_bits <= 2 * QUF_DIGIT_BITS){
+        // two passes at most: nothing to gain
+        radix_sort_lsd(n, x_read, x_write, o_read, o_write, nthreads);
+        return;
+    }
+
+    const int n_buckets = 1 << QUF_DIGIT_BITS;
+    const T mask = static_cast<T>(n_buckets - 1);
+    int shift = bit_min + n_bits - QUF_DIGIT_BITS;
+
+    int n_chunks = nthreads;
+    vector<int> bounds(n_chunks + 1);
+    for(int t=0 ; t<=n_chunks ; ++t){
+        bounds[t] = static_cast<int>((static_cast<long long>(n) * t) / n_chunks);
+    }
+
+    // 1) partitioning on the highest digit, same algorithm as one LSD pass
+    vector<int> radix_table(n_chunks * n_buckets, 0);
+    #pragma omp parallel for num_threads(nthreads)
+    for(int t=0 ; t<n_chunks ; ++t){
+        int *my_table = radix_table.data() + t * n_buckets;
+        T *my_x = x_read;
+        for(int i=bounds[t] ; i<bounds[t + 1] ; ++i){
+            ++my_table[(my_x[i] >> shift) & mask];
         }
+    }
 
-        for(int b=0 ; b<8 ; ++b){
-            x_char = ((unsigned char *)&x_ull_current)[b];
-            ++radix_table[b][x_char];
+    vector<int> offset(n_chunks * n_buckets), bucket_start(n_buckets + 1);
+    int cum = 0;
+    for(int d=0 ; d<n_buckets ; ++d){
+        bucket_start[d] = cum;
+        for(int t=0 ; t<n_chunks ; ++t){
+            offset[t * n_buckets + d] = cum;
+            cum += radix_table[t * n_buckets + d];
+        }
+    }
+    bucket_start[n_buckets] = n;
+
+    #pragma omp parallel for num_threads(nthreads)
+    for(int t=0 ; t<n_chunks ; ++t){
+        int *my_offset = offset.data() + t * n_buckets;
+        T *my_x_read = x_read, *my_x_write = x_write;
+        int *my_o_read = o_read, *my_o_write = o_write;
+        for(int i=bounds[t] ; i<bounds[t + 1] ; ++i){
+            int index = my_offset[(my_x_read[i] >> shift) & mask]++;
+            my_x_write[index] = my_x_read[i];
+            my_o_write[index] = my_o_read[i];
         }
     }
 
-    // 1') skipping
-    vector<bool> skip_flag(8);
-    for(int b = 0 ; b < 8 ; ++b){
-        x_char = ((unsigned char *)&x_ull_current)[b];
-        skip_flag[b] = radix_table[b][x_char] == n;
+    std::swap(x_read, x_write);
+    std::swap(o_read, o_write);
+
+    // 2) sorting the partitions
+    // the sorted partition may end up in the buffer: it is then copied back
+
+    // large partitions (skewed data): sorted one after the other, multi-threaded
+    for(int d=0 ; d<n_buckets ; ++d){
+        int start = bucket_start[d], n_d = bucket_start[d + 1] - start;
+        if(n_d < QUF_MSD_MIN) continue;
+
+        T *x_r = x_read + start, *x_w = x_write + start;
+        int *o_r = o_read + start, *o_w = o_write + start;
+        radix_sort(n_d, x_r, x_w, o_r, o_w, nthreads);
+        if(x_r != x_read + start){
+            memcpy(x_read + start, x_r, n_d * sizeof(T));
+            memcpy(o_read + start, o_r, n_d * sizeof(int));
+        }
     }
 
-    // 2) Cumulating
-    for(int b = 0 ; b < 8 ; ++b){
-        for(int d = 1 ; d < 256 ; ++d){
-            radix_table[b][d] += radix_table[b][d - 1];
+    // the other partitions, in parallel
+    #pragma omp parallel for num_threads(nthreads) schedule(dynamic)
+    for(int d=0 ; d<n_buckets ; ++d){
+        int start = bucket_start[d], n_d = bucket_start[d + 1] - start;
+        if(n_d <= 1 || n_d >= QUF_MSD_MIN) continue;
+
+        T *x_r = x_read + start, *x_w = x_write + start;
+        int *o_r = o_read + start, *o_w = o_write + start;
+        radix_sort_lsd(n_d, x_r, x_w, o_r, o_w, 1);
+        if(x_r != x_read + start){
+            memcpy(x_read + start, x_r, n_d * sizeof(T));
+            memcpy(o_read + start, o_r, n_d * sizeof(int));
         }
     }
+}
+
+template<typename T>
+void radix_unclass(int n, const T *x_sorted, const int *x_order, vector<int> &x_uf,
+                   vector<int> &x_start, int nthreads){
+    // x_sorted, x_order: output of radix_sort
+    // x_uf: the unclassed values, starting at 1
+    // x_start: the position (in the sorted data) of the first element of each value
+
+    int n_chunks = nthreads;
+    vector<int> bounds(n_chunks + 1);
+    for(int t=0 ; t<=n_chunks ; ++t){
+        bounds[t] = static_cast<int>((static_cast<long long>(n) * t) / n_chunks);
+    }
 
-    // 3) Sorting
-    unsigned long long *x_read = px_ulong;
-    unsigned long long *x_write = x_tmp.data();
-    unsigned long long *p_tmp; // used for swapping
+    // number of new values in each chunk
+    vector<int> n_new(n_chunks + 1, 0);
+    #pragma omp parallel for num_threads(nthreads)
+    for(int t=0 ; t<n_chunks ; ++t){
+        int value = 0;
+        for(int i=bounds[t] ; i<bounds[t + 1] ; ++i){
+            if(i == 0 || x_sorted[i] != x_sorted[i - 1]) ++value;
+        }
+        n_new[t + 1] = value;
+    }
 
-    vector<int> x_order(n), x_unclass(n);
-    int *o_read = x_unclass.data();
-    int *o_write = x_order.data();
-    int *o_tmp;
+    for(int t=0 ; t<n_chunks ; ++t){
+        n_new[t + 1] += n_new[t];
+    }
 
-    int k = 0;
-    for(auto &p : x_unclass) p = k++;
+    x_start.resize(n_new[n_chunks]);
 
-    for(int b=0 ; b < 8 ; ++b){
-        if(skip_flag[b] == false){
-            int index;
-            for(int i = n - 1 ; i >= 0 ; --i){
-                x_ull_current = x_read[i];
-                x_char = ((unsigned char *)&x_ull_current)[b];
-                index = --radix_table[b][x_char];
-                x_write[index] = x_read[i];
-                o_write[index] = o_read[i];
+    #pragma omp parallel for num_threads(nthreads)
+    for(int t=0 ; t<n_chunks ; ++t){
+        int k = n_new[t];
+        for(int i=bounds[t] ; i<bounds[t + 1] ; ++i){
+            if(i == 0 || x_sorted[i] != x_sorted[i - 1]){
+                x_start[k] = i;
+                ++k;
             }
+            x_uf[x_order[i]] = k;
+        }
+    }
+}
 
-            p_tmp = x_read;
-            x_read = x_write;
-            x_write = p_tmp;
+void radix_first_appearance(vector<int> &x_uf, vector<int> &first_obs, int nthreads){
+    // x_uf: the unclassed values, from 1 to n_unik, in the order of the sort
+    // first_obs: the first observation of each value
+    // => the values are renumbered in the order of first appearance, first_obs is sorted
+    // so that the sort and the hash table give the same qufing
 
-            o_tmp = o_read;
-            o_read = o_write;
-            o_write = o_tmp;
-        }
+    int n = x_uf.size();
+    int n_unik = first_obs.size();
+
+    vector<unsigned int> key(n_unik), key_tmp(n_unik);
+    vector<int> rank(n_unik), rank_tmp(n_unik);
+    for(int k=0 ; k<n_unik ; ++k){
+        key[k] = first_obs[k];
+        rank[k] = k;
     }
 
+    unsigned int *x_read = key.data(), *x_write = key_tmp.data();
+    int *o_read = rank.data(), *o_write = rank_tmp.data();
+    radix_sort(n_unik, x_read, x_write, o_read, o_write, n_unik < QUF_PAR_MIN ? 1 : nthreads);
 
-    if(o_read != x_order.data()){
-        // we copy the result
-        memcpy(x_order.data(), o_read, sizeof(int) * n);
+    // new_id: id in the order of the sort => id in the order of appearance
+    vector<int> new_id(n_unik);
+    for(int k=0 ; k<n_unik ; ++k){
+        new_id[o_read[k]] = k + 1;
+        first_obs[k] = x_read[k];
     }
 
-    // We unclass, starting at 1
-    k=1;
-    x_unclass[0] = k;
+    int *pnew_id = new_id.data() - 1;
+    #pragma omp parallel for num_threads(nthreads)
+    for(int i=0 ; i<n ; ++i){
+        x_uf[i] = pnew_id[x_uf[i]];
+    }
+}
 
-    unsigned long long xi, xim1 = x_read[0];
-    x_unik.push_back(is_string ? static_cast<double>(x_order[0]  + 1) : ull_to_float(xim1));
+void quf_double(vector<int> &x_uf, void *px, vector<double> &x_unik, bool is_string = false, int nthreads = 1){
 
-    for(int i=1 ; i<n ; ++i){
-        xi = x_read[i];
-        if(xi != xim1){
-            ++k;
-            x_unik.push_back(is_string ? static_cast<double>(x_order[i]  + 1) : ull_to_float(xi));
+    // x_uf: x unclassed factor
+    // px: pointer to x vector (R vector) -- READ ONLY!!!
+    // x_unik: empty vector
+    // px: either double or ULL (in case of strings)
+    // in case of strings, px is used as a buffer during the sort
+
+    int n = x_uf.size();
+    if(n < QUF_PAR_MIN) nthreads = 1;
+
+    double *px_dble = (double *)px;
+    unsigned long long *px_ull = (unsigned long long *)px;
+
+    // one double is made of 8 char
+    vector<unsigned long long> x_ulong(is_string ? 1 : n), x_tmp(n);
+
+    // in case the data is string, we use px as the x_ulong
+    unsigned long long *px_ulong = is_string ? px_ull : x_ulong.data();
+
+    if(!is_string){
+        // we change x double into ulong after flipping to keep order
+        #pragma omp parallel for num_threads(nthreads)
+        for(int i=0 ; i<n ; ++i){
+            px_ulong[i] = float_to_ull(px_dble, i);
         }
-        x_unclass[i] = k;
-        xim1 = xi;
     }
 
-    // We put into the right order
+    vector<int> x_order(n), o_tmp(n);
+    #pragma omp parallel for num_threads(nthreads)
     for(int i=0 ; i<n ; ++i){
-        x_uf[x_order[i]] = x_unclass[i];
+        x_order[i] = i;
+    }
+
+    unsigned long long *x_read = px_ulong, *x_write = x_tmp.data();
+    int *o_read = x_order.data(), *o_write = o_tmp.data();
+    radix_sort(n, x_read, x_write, o_read, o_write, nthreads);
+
+    // We unclass, starting at 1
+    vector<int> x_start;
+    radix_unclass(n, x_read, o_read, x_uf, x_start, nthreads);
+
+    // the sort is stable: the first element of each value is its first observation
+    int n_unik = x_start.size();
+    vector<int> first_obs(n_unik);
+    for(int k=0 ; k<n_unik ; ++k){
+        first_obs[k] = o_read[x_start[k]];
     }
 
+    radix_first_appearance(x_uf, first_obs, nthreads);
+
+    x_unik.resize(n_unik);
+    for(int k=0 ; k<n_unik ; ++k){
+        // strings: the first observation with that value
+        x_unik[k] = is_string ? static_cast<double>(first_obs[k] + 1) : px_dble[first_obs[k]];
+    }
 }
 
-void quf_int_gnl(vector<int> &x_uf, void *px, vector<double> &x_unik, int x_min, bool is_double){
+void quf_int_gnl(vector<int> &x_uf, void *px, vector<double> &x_unik, int x_min, bool is_double, int nthreads = 1){
     // we can sort a range up to 2**31 => ie not the full int range
     // for ranges > 2**31 => as double
     // px: pointer to the values of x -- R vector READ ONLY!!!
@@ -206,99 +488,97 @@ void quf_int_gnl(vector<int> &x_uf, void *px, vector<double> &x_unik, int x_min,
     double *px_dble = (double *)px;
 
     int n = x_uf.size();
+    if(n < QUF_PAR_MIN) nthreads = 1;
 
-    // variables
-    int x_uint_current = 0;
-    vector<int> x_uint(n), x_tmp(n);
-
-    // radix array
-    int radix_table[4][256] = { {0} };
+    vector<unsigned int> x_uint(n), x_tmp(n);
 
-    // 1) Counting
+    #pragma omp parallel for num_threads(nthreads)
     for(int i=0 ; i<n ; ++i){
-        // x_uint_current = px[i] - x_min;
-        x_uint_current = is_double ? static_cast<int>(px_dble[i] - x_min) : px_int[i] - x_min;
-        x_uint[i] = x_uint_current;
-
-        for(int b=0 ; b<4 ; ++b){
-            ++radix_table[b][(x_uint_current >> 8*b) & 0xFF];
-        }
-    }
-
-    // 1') skipping
-    vector<bool> skip_flag(4);
-    for(int b = 0 ; b < 4 ; ++b){
-        skip_flag[b] = radix_table[b][(x_uint_current >> 8*b) & 0xFF] == n;
+        x_uint[i] = is_double ? static_cast<int>(px_dble[i] - x_min) : px_int[i] - x_min;
     }
 
-    // 2) Cumulating
-    for(int b = 0 ; b < 4 ; ++b){
-        for(int d = 1 ; d < 256 ; ++d){
-            radix_table[b][d] += radix_table[b][d - 1];
-        }
+    vector<int> x_order(n), o_tmp(n);
+    #pragma omp parallel for num_threads(nthreads)
+    for(int i=0 ; i<n ; ++i){
+        x_order[i] = i;
     }
 
-    // 3) Sorting
-    int *x_read = x_uint.data();
-    int *x_write = x_tmp.data();
-    int *p_tmp; // used for swapping
+    unsigned int *x_read = x_uint.data(), *x_write = x_tmp.data();
+    int *o_read = x_order.data(), *o_write = o_tmp.data();
+    radix_sort(n, x_read, x_write, o_read, o_write, nthreads);
 
-    vector<int> x_order(n), x_unclass(n);
-    int *o_read = x_unclass.data();
-    int *o_write = x_order.data();
-    int *o_tmp;
-
-    int k = 0;
-    for(auto &p : x_unclass) p = k++;
+    // We unclass, starting at 1
+    vector<int> x_start;
+    radix_unclass(n, x_read, o_read, x_uf, x_start, nthreads);
+
+    // in the order of first appearance, as quf_int
+    int n_unik = x_start.size();
+    vector<int> first_obs(n_unik);
+    for(int k=0 ; k<n_unik ; ++k){
+        first_obs[k] = o_read[x_start[k]];
+    }
 
-    for(int b=0 ; b < 4 ; ++b){
-        if(skip_flag[b] == false){
-            // Rprintf("bin: %i\n", b);
-            int index;
-            for(int i = n - 1 ; i >= 0 ; --i){
-                index = --radix_table[b][(x_read[i] >> 8*b) & 0xFF];
-                x_write[index] = x_read[i];
-                o_write[index] = o_read[i];
-            }
+    radix_first_appearance(x_uf, first_obs, nthreads);
 
-            p_tmp = x_read;
-            x_read = x_write;
-            x_write = p_tmp;
+    x_unik.resize(n_unik);
+    for(int k=0 ; k<n_unik ; ++k){
+        int i = first_obs[k];
+        x_unik[k] = is_double ? px_dble[i] : static_cast<double>(px_int[i]);
+    }
+}
 
-            o_tmp = o_read;
-            o_read = o_write;
-            o_write = o_tmp;
+template<typename T>
+void quf_min_max(const T *px, int n, T &x_min, T &x_max, int nthreads){
+    // min and max of px, by chunk
+
+    if(n < QUF_PAR_MIN) nthreads = 1;
+
+    vector<T> all_min(nthreads, px[0]), all_max(nthreads, px[0]);
+    #pragma omp parallel for num_threads(nthreads)
+    for(int t=0 ; t<nthreads ; ++t){
+        int start = static_cast<int>((static_cast<long long>(n) * t) / nthreads);
+        int end = static_cast<int>((static_cast<long long>(n) * (t + 1)) / nthreads);
+        T my_min = px[0], my_max = px[0];
+        for(int i=start ; i<end ; ++i){
+            T x_tmp = px[i];
+            if(x_tmp > my_max) my_max = x_tmp;
+            if(x_tmp < my_min) my_min = x_tmp;
         }
+        all_min[t] = my_min;
+        all_max[t] = my_max;
     }
 
-    if(o_read != x_order.data()){
-        // we copy the result, if needed
-        memcpy(x_order.data(), o_read, sizeof(int) * n);
+    x_min = all_min[0];
+    x_max = all_max[0];
+    for(int t=1 ; t<nthreads ; ++t){
+        if(all_max[t] > x_max) x_max = all_max[t];
+        if(all_min[t] < x_min) x_min = all_min[t];
     }
+}
 
-    // We unclass, starting at 1
-    k=1;
-    x_unclass[0] = k;
+bool quf_is_int(const double *px, int n, int nthreads){
+    // whether all the values of px are integers
 
-    double xi, xim1 = x_read[0];
-    x_unik.push_back(xim1 + x_min);
+    if(n < QUF_PAR_MIN) nthreads = 1;
 
-    for(int i=1 ; i<n ; ++i){
-        xi = x_read[i];
-        if(xi != xim1){
-            ++k;
-            x_unik.push_back(static_cast<double>(xi + x_min));
+    vector<int> all_int(nthreads, 1);
+    #pragma omp parallel for num_threads(nthreads)
+    for(int t=0 ; t<nthreads ; ++t){
+        int start = static_cast<int>((static_cast<long long>(n) * t) / nthreads);
+        int end = static_cast<int>((static_cast<long long>(n) * (t + 1)) / nthreads);
+        for(int i=start ; i<end ; ++i){
+            if(!(px[i] == (int) px[i])){
+                all_int[t] = 0;
+                break;
+            }
         }
-        x_unclass[i] = k;
-        xim1 = xi;
     }
 
-    // We put into the right order
-    for(int i=0 ; i<n ; ++i){
-        x_uf[x_order[i]] = x_unclass[i];
+    for(int t=0 ; t<nthreads ; ++t){
+        if(!all_int[t]) return false;
     }
 
-
+    return true;
 }
 
 void quf_int(vector<int> &x_uf, void *px, vector<double> &x_unik, int x_min, int max_value, bool is_double = false){
@@ -338,176 +618,1353 @@ void quf_int(vector<int> &x_uf, void *px, vector<double> &x_unik, int x_min, int
 
 }
 
-// [[Rcpp::export]]
-List cpp_quf_str(SEXP x){
+// Paged lookup table: for integers of wide range.
+// The lookup table of quf_int is cut into pages of 1024 values, the pages being allocated only
+// when one of their values appears. For sparse values that are clustered (e.g. identifiers
+// assigned by blocks), only a few pages are needed and we keep the single pass of quf_int.
+// If the values are too spread out, the number of pages exceeds the memory budget and we stop.
 
-    int n = Rf_length(x);
+const int QUF_PAGE_BITS = 10;
+const int QUF_PAGE_SIZE = 1 << QUF_PAGE_BITS;
 
-    vector<int> x_uf(n);
-    vector<double> x_unik;
+bool quf_int_paged(vector<int> &x_uf, void *px, vector<double> &x_unik, int x_min, double max_value, bool is_double = false){
+    // returns false if the memory budget is exceeded (x_uf and x_unik are then meaningless)
+    // max_value: the range of x, lower than 2**32
 
-    // we change the string vector into a uint64 vector
-    // since we don't care about the sorting order, we can just
-    // recast into double (an not uint64)
+    int *px_int = (int *)px;
+    double *px_dble = (double *)px;
 
-    vector<double> x_ull(n);
-    std::uintptr_t xi_uintptr;
-    unsigned long long xi_ull;
+    int n = x_uf.size();
+
+    // directory: for each page, its location in the pool (-1: not allocated)
+    int n_pages = static_cast<int>(static_cast<unsigned int>(max_value) >> QUF_PAGE_BITS) + 1;
+    vector<int> directory(n_pages, -1);
 
+    // memory budget: 4 int per observation
+    size_t pool_max = 4 * static_cast<size_t>(n) + 64 * QUF_PAGE_SIZE;
+    vector<int> pool;
 
+    const unsigned int page_mask = QUF_PAGE_SIZE - 1;
+    unsigned int x_min_uint = static_cast<unsigned int>(x_min);
+    int n_unik = 0;
     for(int i=0 ; i<n ; ++i){
-        const char *pxi = CHAR(STRING_ELT(x, i));
-        xi_uintptr = reinterpret_cast<std::uintptr_t>(pxi);
-        xi_ull = static_cast<unsigned long long>(xi_uintptr);
+        // unsigned: the difference may exceed the int range
+        unsigned int x_tmp = is_double ? static_cast<unsigned int>(px_dble[i] - x_min) : static_cast<unsigned int>(px_int[i]) - x_min_uint;
+
+        int &page = directory[x_tmp >> QUF_PAGE_BITS];
+        if(page == -1){
+            if(pool.size() >= pool_max){
+                x_unik.clear();
+                return false;
+            }
+            page = pool.size();
+            pool.resize(pool.size() + QUF_PAGE_SIZE, 0);
+        }
 
-        x_ull[i] = xi_ull;
+        int &x_pos = pool[page + (x_tmp & page_mask)];
+        if(x_pos == 0){
+            ++n_unik;
+            x_pos = n_unik;
+            x_unik.push_back(is_double ? px_dble[i] : static_cast<double>(px_int[i]));
+        }
 
-        // Rcout << xi_uintptr << "  ----  " << xi_ull << "\n";
+        x_uf[i] = x_pos;
     }
 
-    quf_double(x_uf, x_ull.data(), x_unik, true);
-
-    List res;
-    res["x_uf"] = x_uf;
-    res["x_unik"] = x_unik;
-
-    return res;
+    return true;
 }
 
+// Dense codes: when the values are codes from 1 to k (e.g. R factors), they are already
+// almost qufed. We check the range and find the first appearance of each code in one
+// parallel pass. The codes are then renumbered in order of first appearance, like in the
+// other quf methods (the order of the fixed-effects must not depend on the type of the
+// data): the codes are copied as they are if they already are in that order.
 
+bool quf_dense(vector<int> &x_uf, const int *px, vector<double> &x_unik, int k, int nthreads){
+    // returns false if some values are not in 1..k (NAs included)
+    // x_unik: the codes used, in order of first appearance
 
+    int n = x_uf.size();
+    if(n < QUF_PAR_MIN) nthreads = 1;
+
+    // one table of first appearance per thread (n: absent)
+    vector<int> first_obs(static_cast<size_t>(nthreads) * k, n);
+    vector<int> all_valid(nthreads, 1);
+
+    #pragma omp parallel for num_threads(nthreads)
+    for(int t=0 ; t<nthreads ; ++t){
+        int start = static_cast<int>((static_cast<long long>(n) * t) / nthreads);
+        int end = static_cast<int>((static_cast<long long>(n) * (t + 1)) / nthreads);
+        int *my_first = first_obs.data() + static_cast<size_t>(t) * k;
+        for(int i=start ; i<end ; ++i){
+            int code = px[i];
+            if(code < 1 || code > k){
+                all_valid[t] = 0;
+                break;
+            }
+            if(my_first[code - 1] == n) my_first[code - 1] = i;
+        }
+    }
 
-// [[Rcpp::export]]
-List cpp_quf_gnl(SEXP x){
-
-    // INT: we try as possible to send the data to quf_int, the most efficient function
-    // for data of large range, we have a separate algorithms that avoids the creation
-    // of a possibly too large lookup table.
-    // for extreme ranges (> 2**31) we use the algorithm for double
-
-    // DOUBLE: quf_int is the most efficient function.
-    // even if we have a vector of double, we check whether the underlying structure
-    // is in fact int, so that we can send it to quf_int
-    // if the vector is really double, then the checking cost is negligible
-    // if the vector is in fact int, the cost of checking is largely compensated by the
-    //   efficiency of the algorithm
-
-    // STRING: for string vectors, we first transform them into ULL using their pointer
-    // before applying them the algorithm for doubles
-    // note that the x_unik returned is NOT of type string but is equal to
-    // the location of the unique elements
+    for(int t=0 ; t<nthreads ; ++t){
+        if(!all_valid[t]) return false;
+    }
 
-    int n = Rf_length(x);
+    // the chunks are in order: the first thread having the code saw it first
+    vector<unsigned int> code_first;
+    vector<int> code_used;
+    for(int q=0 ; q<k ; ++q){
+        for(int t=0 ; t<nthreads ; ++t){
+            int i = first_obs[static_cast<size_t>(t) * k + q];
+            if(i < n){
+                code_first.push_back(i);
+                code_used.push_back(q);
+                break;
+            }
+        }
+    }
 
-    vector<int> x_uf(n);
-    vector<double> x_unik;
+    int n_used = code_used.size();
+    if(n_used > 1){
+        vector<unsigned int> x_tmp(n_used);
+        vector<int> o_tmp(n_used);
+        unsigned int *x_read = code_first.data(), *x_write = x_tmp.data();
+        int *o_read = code_used.data(), *o_write = o_tmp.data();
+        radix_sort(n_used, x_read, x_write, o_read, o_write, 1);
+        if(o_read != code_used.data()) memcpy(code_used.data(), o_read, n_used * sizeof(int));
+    }
 
-    // preparation for strings
-    bool IS_STR = false;
-    vector<unsigned long long> x_ull;
+    vector<int> new_code(k, 0);
+    bool is_identity = n_used == k;
+    x_unik.resize(n_used);
+    for(int j=0 ; j<n_used ; ++j){
+        int q = code_used[j];
+        new_code[q] = j + 1;
+        x_unik[j] = q + 1;
+        if(q != j) is_identity = false;
+    }
 
-    bool IS_INT = false;
-    bool is_int_in_double = false;
-    if(TYPEOF(x) == REALSXP){
-        // we check if underlying structure is int
-        IS_INT = true;
-        double *px = REAL(x);
+    if(is_identity){
+        memcpy(x_uf.data(), px, n * sizeof(int));
+    } else {
+        #pragma omp parallel for num_threads(nthreads)
         for(int i=0 ; i<n ; ++i){
-            if(!(px[i] == (int) px[i])){
-                IS_INT = false;
-                break;
-            }
+            x_uf[i] = new_code[px[i] - 1];
         }
+    }
 
-        is_int_in_double = IS_INT; // true: only if x is REAL + INT test OK
-    } else if(TYPEOF(x) == STRSXP){
+    return true;
+}
 
-        IS_STR = true;
-        std::uintptr_t xi_uintptr;
+//
+// Hash-based qufing
+//
+
+// For strings and doubles the order of the values doesn't matter, so a sort is not required:
+// a hash table gives the qufing in a single pass. It is much faster than the radix sort when
+// the number of unique values is small enough so that the table stays in the cache.
+// The keys are the pointers of the strings, or the bits of the doubles.
+// Multi-threaded versions, the values are always in the order of first appearance so that
+// the result does not depend on the number of threads:
+// - few values: each thread qufs its chunk with its own table, the tables are then merged
+// - many values: the observations are partitioned with the high bits of the hash,
+//   then each partition is qufed with its own table. The values are finally renumbered.
+
+// the radix sort is used above this estimated number of unique values
+const int QUF_HASH_MAX = 1 << 20;
+// number of partitions: fixed, independent from the number of threads
+const int QUF_HASH_N_PART = 64;
+
+inline unsigned long long quf_hash(unsigned long long key){
+    // splitmix64 finalizer
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return key;
+}
 
-        for(int i=0 ; i<n ; ++i){
-            const char *pxi = CHAR(STRING_ELT(x, i));
-            xi_uintptr = reinterpret_cast<std::uintptr_t>(pxi);
+inline unsigned long long quf_key(void *px, int i, bool is_string){
+    if(is_string){
+        return ((unsigned long long *)px)[i];
+    }
 
-            x_ull.push_back(static_cast<unsigned long long>(xi_uintptr));
+    double x = ((double *)px)[i];
+    // -0 == 0
+    if(x == 0) return 0;
 
-            // Rcout << xi_uintptr << "  ----  " << xi_ull << "\n";
-        }
-    } else {
-        IS_INT = true;
+    unsigned long long key;
+    memcpy(&key, &x, sizeof(double));
+    return key;
+}
+
+struct QUF_TABLE{
+    // open addressing with linear probing, id == 0 means empty
+    int n_unik = 0;
+    unsigned long long mask;
+    vector<unsigned long long> key;
+    vector<int> id;
+
+    QUF_TABLE(int n_expected){
+        unsigned long long size = 16;
+        while(size < 2 * static_cast<unsigned long long>(n_expected)) size <<= 1;
+        mask = size - 1;
+        key.resize(size);
+        id.assign(size, 0);
     }
 
-    if(IS_INT){
-        // integer
+    void grow(){
+        vector<unsigned long long> key_old;
+        vector<int> id_old;
+        key_old.swap(key);
+        id_old.swap(id);
+
+        mask = 2 * mask + 1;
+        key.resize(mask + 1);
+        id.assign(mask + 1, 0);
+
+        for(size_t j=0 ; j<id_old.size() ; ++j){
+            if(id_old[j] == 0) continue;
+            unsigned long long h = quf_hash(key_old[j]) & mask;
+            while(id[h] != 0) h = (h + 1) & mask;
+            key[h] = key_old[j];
+            id[h] = id_old[j];
+        }
+    }
 
-        double max_value;
-        void *px_generic;
-        int X_MIN;
-        if(is_int_in_double){
-            double *px = REAL(x);
-            px_generic = REAL(x);
-            double x_min = px[0], x_max = px[0], x_tmp;
-            for(int i=1 ; i<n ; ++i){
-                x_tmp = px[i];
-                if(x_tmp > x_max) x_max = x_tmp;
-                if(x_tmp < x_min) x_min = x_tmp;
-            }
-            X_MIN = static_cast<int>(x_min);
-            max_value = x_max - x_min;
-        } else {
-            int *px = INTEGER(x);
-            px_generic = INTEGER(x);
-            int x_min = px[0], x_max = px[0], x_tmp;
-            for(int i=1 ; i<n ; ++i){
-                x_tmp = px[i];
-                if(x_tmp > x_max) x_max = x_tmp;
-                if(x_tmp < x_min) x_min = x_tmp;
+    // returns the id of the key (starting at 1), is_new: whether the key was inserted
+    int get_id(unsigned long long x_key, unsigned long long hash, bool &is_new){
+        unsigned long long h = hash & mask;
+        while(id[h] != 0){
+            if(key[h] == x_key){
+                is_new = false;
+                return id[h];
             }
-            X_MIN = x_min;
-            max_value = x_max - x_min;
+            h = (h + 1) & mask;
         }
 
-        // creating + copying a 10**5 vector takes about 0.5ms which is OK even if n << 10**5
-        // quf_int is really extremely efficient, so we use it whenever appropriate
-        // In quf_int_gnl we create two n-size vectors + the method is less efficient by construction
-        // so we go into quf_int whenever max_value <= 2.5*n
+        is_new = true;
+        ++n_unik;
+        key[h] = x_key;
+        id[h] = n_unik;
 
-        if(max_value < 100000 || max_value <= 2.5*n){
-            quf_int(x_uf, px_generic, x_unik, X_MIN, static_cast<int>(max_value), is_int_in_double);
-        } else if(max_value < 0x10000000){
-            // we don't cover ranges > 2**31 (uints are pain in the neck)
-            quf_int_gnl(x_uf, px_generic, x_unik, X_MIN, is_int_in_double);
-        } else {
-            // ranges > 2**31 => as double
+        if(2 * static_cast<unsigned long long>(n_unik) > mask){
+            grow();
+        }
 
-            if(is_int_in_double){
-                quf_double(x_uf, (double *)px_generic, x_unik);
-            } else {
-                // we need to create a vector of double, otherwise: pointer issue
-                vector<double> x_dble(n);
-                int *px = INTEGER(x);
-                for(int i=0 ; i<n ; ++i) x_dble[i] = static_cast<double>(px[i]);
-                quf_double(x_uf, x_dble.data(), x_unik);
-            }
+        return n_unik;
+    }
+
+    // id of the key, 0 if absent (read only: can be used in parallel)
+    int find(unsigned long long x_key, unsigned long long hash) const {
+        unsigned long long h = hash & mask;
+        while(id[h] != 0){
+            if(key[h] == x_key) return id[h];
+            h = (h + 1) & mask;
         }
+        return 0;
+    }
+};
 
-    } else if(IS_STR){
-        // string -- beforehand transformed as ULL
-        quf_double(x_uf, x_ull.data(), x_unik, true);
-    } else {
-        // double
-        double *px = REAL(x);
-        quf_double(x_uf, px, x_unik);
+// size of the sample used to estimate the number of unique values
+const int QUF_N_SAMPLE = 8192;
+
+double quf_n_unik_sample(const vector<unsigned long long> &sample_key, int n){
+    // estimation of the number of unique values from a sample of the keys
+    // Chao1 estimator (bias corrected): d + f1 * (f1 - 1) / (2 * (f2 + 1))
+    // with d the number of unique values in the sample, f1/f2 the number of values
+    // appearing once/twice
+
+    int n_sample = sample_key.size();
+
+    QUF_TABLE table(n_sample);
+    vector<int> count(n_sample + 1, 0);
+    bool is_new;
+    for(int s=0 ; s<n_sample ; ++s){
+        unsigned long long x_key = sample_key[s];
+        ++count[table.get_id(x_key, quf_hash(x_key), is_new)];
     }
 
-    List res;
-    res["x_uf"] = x_uf;
-    res["x_unik"] = x_unik;
+    double d = table.n_unik, f1 = 0, f2 = 0;
+    for(int k=1 ; k<=table.n_unik ; ++k){
+        if(count[k] == 1) ++f1;
+        if(count[k] == 2) ++f2;
+    }
 
-    return res;
+    double n_unik = d + f1 * (f1 - 1) / (2 * (f2 + 1));
+
+    return n_unik < n ? n_unik : n;
 }
 
+double quf_hash_n_unik(void *px, int n, bool is_string){
+    // estimation of the number of unique values of px
 
+    int n_sample = n < QUF_N_SAMPLE ? n : QUF_N_SAMPLE;
+    double step = static_cast<double>(n) / n_sample;
 
+    vector<unsigned long long> sample_key(n_sample);
+    for(int s=0 ; s<n_sample ; ++s){
+        sample_key[s] = quf_key(px, static_cast<int>(s * step), is_string);
+    }
 
+    return quf_n_unik_sample(sample_key, n);
+}
+
+void quf_hash_seq(vector<int> &x_uf, void *px, vector<int> &first_obs, bool is_string, int n_expected){
+    // x_uf: the values, in order of appearance
+    // first_obs: the first observation of each value (starting at 0)
+
+    int n = x_uf.size();
+    QUF_TABLE table(n_expected);
+    bool is_new;
+    for(int i=0 ; i<n ; ++i){
+        unsigned long long x_key = quf_key(px, i, is_string);
+        x_uf[i] = table.get_id(x_key, quf_hash(x_key), is_new);
+        if(is_new) first_obs.push_back(i);
+    }
+}
+
+void quf_hash_chunk(vector<int> &x_uf, void *px, vector<int> &first_obs, bool is_string, int n_expected, int nthreads){
+    // same as quf_hash_seq, for few unique values
+    // each thread qufs its chunk with its own table, then the tables are merged
+    // in the order of the chunks: the values are in order of first appearance
+
+    int n = x_uf.size();
+    int n_chunks = nthreads;
+    vector<int> bounds(n_chunks + 1);
+    for(int t=0 ; t<=n_chunks ; ++t){
+        bounds[t] = static_cast<int>((static_cast<long long>(n) * t) / n_chunks);
+    }
+
+    vector< vector<int> > chunk_first_obs(n_chunks);
+
+    #pragma omp parallel for num_threads(nthreads)
+    for(int t=0 ; t<n_chunks ; ++t){
+        QUF_TABLE table(n_expected);
+        vector<int> &my_first_obs = chunk_first_obs[t];
+        bool is_new;
+        for(int i=bounds[t] ; i<bounds[t + 1] ; ++i){
+            unsigned long long x_key = quf_key(px, i, is_string);
+            x_uf[i] = table.get_id(x_key, quf_hash(x_key), is_new);
+            if(is_new) my_first_obs.push_back(i);
+        }
+    }
+
+    // merging: local id => global id
+    QUF_TABLE table(n_expected);
+    vector< vector<int> > new_id(n_chunks);
+    bool is_new;
+    for(int t=0 ; t<n_chunks ; ++t){
+        vector<int> &my_first_obs = chunk_first_obs[t];
+        new_id[t].resize(my_first_obs.size() + 1);
+        for(size_t k=0 ; k<my_first_obs.size() ; ++k){
+            int i = my_first_obs[k];
+            unsigned long long x_key = quf_key(px, i, is_string);
+            new_id[t][k + 1] = table.get_id(x_key, quf_hash(x_key), is_new);
+            if(is_new) first_obs.push_back(i);
+        }
+    }
+
+    #pragma omp parallel for num_threads(nthreads)
+    for(int t=0 ; t<n_chunks ; ++t){
+        int *my_new_id = new_id[t].data();
+        for(int i=bounds[t] ; i<bounds[t + 1] ; ++i){
+            x_uf[i] = my_new_id[x_uf[i]];
+        }
+    }
+}
+
+void quf_hash_par(vector<int> &x_uf, void *px, vector<int> &first_obs, bool is_string, int n_expected, int nthreads){
+    // same as quf_hash_seq
+
+    int n = x_uf.size();
+    const int n_part = QUF_HASH_N_PART;
+    int n_chunks = nthreads;
+    vector<int> bounds(n_chunks + 1);
+    for(int t=0 ; t<=n_chunks ; ++t){
+        bounds[t] = static_cast<int>((static_cast<long long>(n) * t) / n_chunks);
+    }
+
+    // 1) partition of each observation (high bits of the hash), counted by chunk
+    vector<unsigned char> x_part(n);
+    vector<int> part_table(n_chunks * n_part, 0);
+
+    #pragma omp parallel for num_threads(nthreads)
+    for(int t=0 ; t<n_chunks ; ++t){
+        int *my_table = part_table.data() + t * n_part;
+        for(int i=bounds[t] ; i<bounds[t + 1] ; ++i){
+            int p = quf_hash(quf_key(px, i, is_string)) >> 58;
+            x_part[i] = p;
+            ++my_table[p];
+        }
+    }
+
+    // 2) the observations, partition by partition (in increasing order)
+    vector<int> part_start(n_part + 1, 0), offset(n_chunks * n_part);
+    int cum = 0;
+    for(int p=0 ; p<n_part ; ++p){
+        part_start[p] = cum;
+        for(int t=0 ; t<n_chunks ; ++t){
+            offset[t * n_part + p] = cum;
+            cum += part_table[t * n_part + p];
+        }
+    }
+    part_start[n_part] = n;
+
+    vector<int> obs(n);
+    #pragma omp parallel for num_threads(nthreads)
+    for(int t=0 ; t<n_chunks ; ++t){
+        int *my_offset = offset.data() + t * n_part;
+        for(int i=bounds[t] ; i<bounds[t + 1] ; ++i){
+            obs[my_offset[x_part[i]]++] = i;
+        }
+    }
+
+    // 3) one table per partition
+    vector< vector<int> > part_first_obs(n_part);
+    int n_expected_part = n_expected / n_part + 1;
+
+    #pragma omp parallel for num_threads(nthreads) schedule(dynamic, 1)
+    for(int p=0 ; p<n_part ; ++p){
+        QUF_TABLE table(n_expected_part);
+        vector<int> &my_first_obs = part_first_obs[p];
+        bool is_new;
+        for(int j=part_start[p] ; j<part_start[p + 1] ; ++j){
+            int i = obs[j];
+            unsigned long long x_key = quf_key(px, i, is_string);
+            x_uf[i] = table.get_id(x_key, quf_hash(x_key), is_new);
+            if(is_new) my_first_obs.push_back(i);
+        }
+    }
+
+    // 4) renumbering in the order of first appearance
+    //    we sort the first observations of all the values
+    vector<int> part_n_unik(n_part + 1, 0);
+    for(int p=0 ; p<n_part ; ++p){
+        part_n_unik[p + 1] = part_n_unik[p] + part_first_obs[p].size();
+    }
+    int n_unik = part_n_unik[n_part];
+
+    vector<unsigned int> key_first(n_unik), key_tmp(n_unik);
+    vector<int> rank(n_unik), rank_tmp(n_unik);
+    for(int p=0 ; p<n_part ; ++p){
+        for(size_t k=0 ; k<part_first_obs[p].size() ; ++k){
+            key_first[part_n_unik[p] + k] = part_first_obs[p][k];
+            rank[part_n_unik[p] + k] = part_n_unik[p] + k;
+        }
+    }
+
+    unsigned int *x_read = key_first.data(), *x_write = key_tmp.data();
+    int *o_read = rank.data(), *o_write = rank_tmp.data();
+    radix_sort(n_unik, x_read, x_write, o_read, o_write, n_unik < QUF_PAR_MIN ? 1 : nthreads);
+
+    // new_id: global id (partition + local id) => id in order of appearance
+    vector<int> new_id(n_unik);
+    first_obs.resize(n_unik);
+    for(int k=0 ; k<n_unik ; ++k){
+        new_id[o_read[k]] = k + 1;
+        first_obs[k] = x_read[k];
+    }
+
+    #pragma omp parallel for num_threads(nthreads) schedule(dynamic, 1)
+    for(int p=0 ; p<n_part ; ++p){
+        int *my_new_id = new_id.data() + part_n_unik[p] - 1;
+        for(int j=part_start[p] ; j<part_start[p + 1] ; ++j){
+            int i = obs[j];
+            x_uf[i] = my_new_id[x_uf[i]];
+        }
+    }
+}
+
+void quf_double_gnl(vector<int> &x_uf, void *px, vector<double> &x_unik, bool is_string, int nthreads){
+    // qufing of doubles or strings (px: ULL pointers, see quf_double)
+    // we choose between the hash table and the radix sort from an estimation
+    // of the number of unique values
+
+    int n = x_uf.size();
+    double n_unik_est = quf_hash_n_unik(px, n, is_string);
+
+    if(n_unik_est > QUF_HASH_MAX){
+        quf_double(x_uf, px, x_unik, is_string, nthreads);
+        return;
+    }
+
+    // multi-threaded: one table per chunk if there are few values (the merging is cheap)
+    //                 one table per partition of the values otherwise
+    vector<int> first_obs;
+    if(n < QUF_PAR_MIN || nthreads == 1){
+        quf_hash_seq(x_uf, px, first_obs, is_string, static_cast<int>(n_unik_est));
+    } else if(n_unik_est * nthreads < n / 4){
+        quf_hash_chunk(x_uf, px, first_obs, is_string, static_cast<int>(n_unik_est), nthreads);
+    } else {
+        quf_hash_par(x_uf, px, first_obs, is_string, static_cast<int>(n_unik_est), nthreads);
+    }
+
+    int n_unik = first_obs.size();
+    x_unik.resize(n_unik);
+    double *px_dble = (double *)px;
+    for(int k=0 ; k<n_unik ; ++k){
+        // strings: the first observation with that value
+        x_unik[k] = is_string ? static_cast<double>(first_obs[k] + 1) : px_dble[first_obs[k]];
+    }
+}
+
+void quf_int_wide(vector<int> &x_uf, void *px, vector<double> &x_unik, int x_min, double max_value, bool is_double, int nthreads){
+    // qufing of integers whose range is too wide for quf_int (max_value < 2**32)
+    // - paged lookup table if the values fall in few pages
+    // - hash table if there are few unique values
+    // - radix sort otherwise
+    // the choice is made from a sample
+
+    int *px_int = (int *)px;
+    double *px_dble = (double *)px;
+
+    int n = x_uf.size();
+    if(n < QUF_PAR_MIN) nthreads = 1;
+
+    unsigned int x_min_uint = static_cast<unsigned int>(x_min);
+
+    int n_sample = n < QUF_N_SAMPLE ? n : QUF_N_SAMPLE;
+    double step = static_cast<double>(n) / n_sample;
+    vector<unsigned long long> sample_value(n_sample), sample_page(n_sample);
+    for(int s=0 ; s<n_sample ; ++s){
+        int i = static_cast<int>(s * step);
+        unsigned int x_tmp = is_double ? static_cast<unsigned int>(px_dble[i] - x_min) : static_cast<unsigned int>(px_int[i]) - x_min_uint;
+        sample_value[s] = x_tmp;
+        sample_page[s] = x_tmp >> QUF_PAGE_BITS;
+    }
+
+    double n_pages_est = quf_n_unik_sample(sample_page, n);
+    if(max_value < 2.0 * n * QUF_PAGE_SIZE && n_pages_est * QUF_PAGE_SIZE < 2.0 * n){
+        if(quf_int_paged(x_uf, px, x_unik, x_min, max_value, is_double)){
+            return;
+        }
+    }
+
+    double n_unik_est = quf_n_unik_sample(sample_value, n);
+    if(n_unik_est > QUF_HASH_MAX && max_value < 2147483648.0){
+        // quf_int_gnl sorts x - x_min as int: range < 2**31 only (uints are pain in the neck)
+        quf_int_gnl(x_uf, px, x_unik, x_min, is_double, nthreads);
+        return;
+    }
+
+    // the keys: x - x_min on 64 bits, qufed as strings (hash table or radix sort)
+    vector<unsigned long long> x_key(n);
+    #pragma omp parallel for num_threads(nthreads)
+    for(int i=0 ; i<n ; ++i){
+        x_key[i] = is_double ? static_cast<unsigned int>(px_dble[i] - x_min) : static_cast<unsigned int>(px_int[i]) - x_min_uint;
+    }
+
+    quf_double_gnl(x_uf, x_key.data(), x_unik, true, nthreads);
+
+    // x_unik: from the location of the first element to the value
+    int n_unik = x_unik.size();
+    for(int k=0 ; k<n_unik ; ++k){
+        int i = static_cast<int>(x_unik[k]) - 1;
+        x_unik[k] = is_double ? px_dble[i] : static_cast<double>(px_int[i]);
+    }
+}
+
+// [[Rcpp::export]]
+List cpp_quf_str(SEXP x, int nthreads = 1){
+
+    int n = Rf_length(x);
+
+    vector<int> x_uf(n);
+    vector<double> x_unik;
+
+    // we change the string vector into a uint64 vector
+    // since we don't care about the sorting order, we can just
+    // recast into double (an not uint64)
+
+    vector<double> x_ull(n);
+    std::uintptr_t xi_uintptr;
+    unsigned long long xi_ull;
+
+
+    for(int i=0 ; i<n ; ++i){
+        const char *pxi = CHAR(STRING_ELT(x, i));
+        xi_uintptr = reinterpret_cast<std::uintptr_t>(pxi);
+        xi_ull = static_cast<unsigned long long>(xi_uintptr);
+
+        x_ull[i] = xi_ull;
+
+        // Rcout << xi_uintptr << "  ----  " << xi_ull << "\n";
+    }
+
+    quf_double_gnl(x_uf, x_ull.data(), x_unik, true, nthreads);
+
+    List res;
+    res["x_uf"] = x_uf;
+    res["x_unik"] = x_unik;
+
+    return res;
+}
+
+
+
+
+void quf_gnl(SEXP x, vector<int> &x_uf, vector<double> &x_unik, int nthreads){
+
+    // x_uf: must be of the length of x
+    // x_unik: empty vector
+
+    // INT: we try as possible to send the data to quf_int, the most efficient function
+    // for data of large range, we have a separate algorithms that avoids the creation
+    // of a possibly too large lookup table.
+    // for extreme ranges (> 2**31) we use the algorithm for double
+
+    // DOUBLE: quf_int is the most efficient function.
+    // even if we have a vector of double, we check whether the underlying structure
+    // is in fact int, so that we can send it to quf_int
+    // if the vector is really double, then the checking cost is negligible
+    // if the vector is in fact int, the cost of checking is largely compensated by the
+    //   efficiency of the algorithm
+
+    // STRING: for string vectors, we first transform them into ULL using their pointer
+    // before applying them the algorithm for doubles
+    // DOUBLE/STRING: hash table or radix sort, depending on the estimated number of
+    //   unique values (see quf_double_gnl)
+    // note that the x_unik returned is NOT of type string but is equal to
+    // the location of the unique elements
+
+    // INT64 (class integer64 from bit64): as the strings, x_unik is the location of the unique elements
+
+    int n = Rf_length(x);
+
+    // preparation for strings
+    bool IS_STR = false;
+    vector<unsigned long long> x_ull;
+
+    bool IS_INT = false;
+    bool is_int_in_double = false;
+    if(TYPEOF(x) == REALSXP && Rf_inherits(x, "integer64")){
+        // INT64: bit64 stores the 64 bits integers in doubles
+        // their bits are the keys, as for the strings (x_unik is the location of the unique elements)
+        // we copy x since the radix sort uses the keys as a buffer
+
+        x_ull.resize(n);
+        memcpy(x_ull.data(), REAL(x), n * sizeof(double));
+
+        quf_double_gnl(x_uf, x_ull.data(), x_unik, true, nthreads);
+        return;
+
+    } else if(TYPEOF(x) == REALSXP){
+        // we check if underlying structure is int
+        IS_INT = quf_is_int(REAL(x), n, nthreads);
+
+        is_int_in_double = IS_INT; // true: only if x is REAL + INT test OK
+    } else if(TYPEOF(x) == STRSXP){
+
+        IS_STR = true;
+        std::uintptr_t xi_uintptr;
+
+        for(int i=0 ; i<n ; ++i){
+            const char *pxi = CHAR(STRING_ELT(x, i));
+            xi_uintptr = reinterpret_cast<std::uintptr_t>(pxi);
+
+            x_ull.push_back(static_cast<unsigned long long>(xi_uintptr));
+
+            // Rcout << xi_uintptr << "  ----  " << xi_ull << "\n";
+        }
+    } else {
+        IS_INT = true;
+    }
+
+    if(IS_INT){
+        // integer
+
+        double max_value;
+        void *px_generic;
+        int X_MIN;
+        if(is_int_in_double){
+            px_generic = REAL(x);
+            double x_min, x_max;
+            quf_min_max(REAL(x), n, x_min, x_max, nthreads);
+            X_MIN = static_cast<int>(x_min);
+            max_value = x_max - x_min;
+        } else {
+            px_generic = INTEGER(x);
+            int x_min, x_max;
+            quf_min_max(INTEGER(x), n, x_min, x_max, nthreads);
+            X_MIN = x_min;
+            max_value = static_cast<double>(x_max) - x_min;
+        }
+
+        // creating + copying a 10**5 vector takes about 0.5ms which is OK even if n << 10**5
+        // quf_int is really extremely efficient, so we use it whenever appropriate
+        // In quf_int_gnl we create two n-size vectors + the method is less efficient by construction
+        // so we go into quf_int whenever max_value <= 2.5*n
+
+        // for larger ranges: paged lookup table, hash table or radix sort (see quf_int_wide)
+
+        // integers from 1 to k <= n: likely already dense codes (quf_dense always succeeds here)
+
+        if(!is_int_in_double && X_MIN == 1 && max_value < n){
+            quf_dense(x_uf, INTEGER(x), x_unik, static_cast<int>(max_value) + 1, nthreads);
+        } else if(max_value < 100000 || max_value <= 2.5*n){
+            quf_int(x_uf, px_generic, x_unik, X_MIN, static_cast<int>(max_value), is_int_in_double);
+        } else {
+            quf_int_wide(x_uf, px_generic, x_unik, X_MIN, max_value, is_int_in_double, nthreads);
+        }
+
+    } else if(IS_STR){
+        // string -- beforehand transformed as ULL
+        quf_double_gnl(x_uf, x_ull.data(), x_unik, true, nthreads);
+    } else {
+        // double
+        double *px = REAL(x);
+        quf_double_gnl(x_uf, px, x_unik, false, nthreads);
+    }
+}
+
+// [[Rcpp::export]]
+List cpp_quf_gnl(SEXP x, int nthreads = 1){
+
+    int n = Rf_length(x);
+
+    vector<int> x_uf(n);
+    vector<double> x_unik;
+
+    quf_gnl(x, x_uf, x_unik, nthreads);
+
+    List res;
+    res["x_uf"] = x_uf;
+    res["x_unik"] = x_unik;
+
+    return res;
+}
+
+// [[Rcpp::export]]
+List cpp_quf_dense(SEXP x, int k, int nthreads = 1){
+    // x: integer codes from 1 to k, typically the codes of a factor with k levels
+    // is_dense: false if some values are not in 1..k (e.g. NAs), then the other elements are absent
+    // x_uf: the codes, renumbered in order of first appearance (unused codes dropped)
+    // x_unik: the codes used, in order of first appearance
+
+    int n = Rf_length(x);
+
+    vector<int> x_uf(n);
+    vector<double> x_unik;
+
+    List res;
+    if(TYPEOF(x) != INTSXP || !quf_dense(x_uf, INTEGER(x), x_unik, k, nthreads)){
+        res["is_dense"] = false;
+        return res;
+    }
+
+    res["is_dense"] = true;
+    res["x_uf"] = x_uf;
+    res["x_unik"] = x_unik;
+
+    return res;
+}
+
+
+//
+// Qufing + table
+//
+
+// The fixed-effects algorithms need, on top of the ids: the number of observations per value,
+// their cumulative sum, the observations sorted by value and the sum of the dependent variable per value.
+// Once the ids are dense, all these are obtained with a single counting pass + a stable scatter.
+
+void quf_table_sum(const int *x_uf, int n, int k, SEXP y, bool do_sum, bool do_order, List &res){
+    // x_uf: dense ids, from 1 to k
+
+    vector<double> table(k, 0);
+    vector<double> sum_y(do_sum ? k : 0, 0);
+
+    if(do_sum){
+        double *py = REAL(y);
+        for(int i=0 ; i<n ; ++i){
+            int q = x_uf[i] - 1;
+            ++table[q];
+            sum_y[q] += py[i];
+        }
+    } else {
+        for(int i=0 ; i<n ; ++i){
+            ++table[x_uf[i] - 1];
+        }
+    }
+
+    vector<int> cumtable(k);
+    int cum = 0;
+    for(int q=0 ; q<k ; ++q){
+        cum += static_cast<int>(table[q]);
+        cumtable[q] = cum;
+    }
+
+    // observations (starting at 0) sorted by value: same as order(x_uf) - 1
+    vector<int> obs_order(do_order ? n : 0);
+    if(do_order){
+        vector<int> position(k);
+        for(int q=0 ; q<k ; ++q){
+            position[q] = cumtable[q] - static_cast<int>(table[q]);
+        }
+
+        for(int i=0 ; i<n ; ++i){
+            obs_order[position[x_uf[i] - 1]++] = i;
+        }
+    }
+
+    res["table"] = table;
+    res["sum_y"] = sum_y;
+    res["cumtable"] = cumtable;
+    res["obs_order"] = obs_order;
+}
+
+// [[Rcpp::export]]
+List cpp_quf_table_sum(SEXP x, SEXP y, bool do_sum, bool do_order, int nthreads = 1){
+    // x: the vector to quf
+    // y: the vector to sum by value (numeric, used only if do_sum)
+
+    int n = Rf_length(x);
+
+    vector<int> x_uf(n);
+    vector<double> x_unik;
+
+    quf_gnl(x, x_uf, x_unik, nthreads);
+
+    List res;
+    quf_table_sum(x_uf.data(), n, x_unik.size(), y, do_sum, do_order, res);
+
+    res["x_uf"] = x_uf;
+    res["x_unik"] = x_unik;
+
+    return res;
+}
+
+// [[Rcpp::export]]
+List cpp_table_sum(int k, IntegerVector dum, SEXP y, bool do_sum, bool do_order){
+    // same as cpp_quf_table_sum for ids already dense (from 1 to k)
+
+    List res;
+    quf_table_sum(dum.begin(), dum.size(), k, y, do_sum, do_order, res);
+
+    return res;
+}
+
+//
+// Combination of several vectors
+//
+
+// Qufing the combination of several vectors: e.g. the fixed-effect var1^var2.
+// The vectors are qufed one by one, then combined sequentially by pairs:
+// the pair (id_acc, id_new) is either the index of a lookup table (when the number of
+// cells is small) or a 64 bits key qufed like the strings (hash table or radix sort).
+// No intermediary strings are created, and there is no limit on the number of values.
+
+void quf_pair(vector<int> &id_acc, int &n_acc, const vector<int> &id_new, int n_new, int nthreads){
+    // id_acc: the ids of the combination so far (starting at 1), updated in place
+    // n_acc: its number of unique values, updated
+    // id_new, n_new: the next vector to combine
+
+    int n = id_acc.size();
+    if(n < QUF_PAR_MIN) nthreads = 1;
+
+    double n_cells = static_cast<double>(n_acc) * n_new;
+
+    // the lookup table is indexed with 64 bits integers, and limited to INT_MAX cells
+    if(n_cells <= INT_MAX && (n_cells < 100000 || n_cells <= 2.5*n)){
+        // lookup table, the values are in order of first appearance
+        vector<int> lookup(static_cast<size_t>(n_cells), 0);
+        int n_unik = 0;
+        for(int i=0 ; i<n ; ++i){
+            size_t key = static_cast<size_t>(id_acc[i] - 1) * n_new + id_new[i] - 1;
+            if(lookup[key] == 0){
+                ++n_unik;
+                lookup[key] = n_unik;
+            }
+            id_acc[i] = lookup[key];
+        }
+
+        n_acc = n_unik;
+
+    } else {
+        vector<unsigned long long> x_key(n);
+        #pragma omp parallel for num_threads(nthreads)
+        for(int i=0 ; i<n ; ++i){
+            x_key[i] = (static_cast<unsigned long long>(id_acc[i]) << 32) | static_cast<unsigned int>(id_new[i]);
+        }
+
+        // the keys are treated as strings: they are qufed as is, and used as buffer
+        vector<double> x_unik;
+        quf_double_gnl(id_acc, x_key.data(), x_unik, true, nthreads);
+
+        n_acc = x_unik.size();
+    }
+}
+
+// [[Rcpp::export]]
+List cpp_quf_multi(SEXP x_list, int nthreads = 1){
+    // x_list: list of vectors of the same length (int, double or string)
+    // returns x_uf: the combined ids, starting at 1
+    //         x_first: for each combined value, the first observation having it (starting at 1)
+
+    int Q = Rf_length(x_list);
+    if(Q == 0) stop("cpp_quf_multi: at least one vector is required.");
+
+    int n = Rf_length(VECTOR_ELT(x_list, 0));
+    for(int q=1 ; q<Q ; ++q){
+        if(Rf_length(VECTOR_ELT(x_list, q)) != n){
+            stop("The vectors to combine must be of the same length.");
+        }
+    }
+
+    vector<int> x_uf(n);
+    vector<double> x_unik;
+    quf_gnl(VECTOR_ELT(x_list, 0), x_uf, x_unik, nthreads);
+    int n_acc = x_unik.size();
+
+    vector<int> id_new(n);
+    for(int q=1 ; q<Q ; ++q){
+        vector<double> x_unik_new;
+        quf_gnl(VECTOR_ELT(x_list, q), id_new, x_unik_new, nthreads);
+        quf_pair(x_uf, n_acc, id_new, x_unik_new.size(), nthreads);
+    }
+
+    vector<int> x_first(n_acc, 0);
+    for(int i=0 ; i<n ; ++i){
+        if(x_first[x_uf[i] - 1] == 0) x_first[x_uf[i] - 1] = i + 1;
+    }
+
+    List res;
+    res["x_uf"] = x_uf;
+    res["x_first"] = x_first;
+
+    return res;
+}
+
+
+//
+// Hash of a vector
+//
+
+// Used to cache the qufing of vectors (see quf_cached in R): the key of the cache is a 64 bits
+// hash of the content of the vector (the pointers for the strings), with its type and length.
+// The data is cut into chunks of fixed size whose hashes are combined in order: the result
+// does not depend on the number of threads.
+
+const int QUF_HASH_CHUNK = 1 << 16;
+
+template<typename T>
+unsigned long long quf_hash_chunks(const T *px, int n, int nthreads){
+
+    int n_chunks = n / QUF_HASH_CHUNK + 1;
+    if(n < QUF_PAR_MIN) nthreads = 1;
+
+    vector<unsigned long long> chunk_hash(n_chunks);
+
+    #pragma omp parallel for num_threads(nthreads)
+    for(int c=0 ; c<n_chunks ; ++c){
+        int start = c * QUF_HASH_CHUNK;
+        int end = start + QUF_HASH_CHUNK < n ? start + QUF_HASH_CHUNK : n;
+        // 4 independent lanes: the latency of the hash is not a bottleneck
+        unsigned long long h[4] = {4ULL * c, 4ULL * c + 1, 4ULL * c + 2, 4ULL * c + 3};
+        for(int i=start ; i<end ; ++i){
+            unsigned long long x_bits = 0;
+            memcpy(&x_bits, px + i, sizeof(T));
+            h[i & 3] = quf_hash(h[i & 3] + x_bits);
+        }
+        chunk_hash[c] = quf_hash(quf_hash(quf_hash(h[0]) ^ h[1]) ^ h[2]) ^ h[3];
+    }
+
+    unsigned long long h = n;
+    for(int c=0 ; c<n_chunks ; ++c){
+        h = quf_hash(h ^ chunk_hash[c]);
+    }
+
+    return h;
+}
+
+// [[Rcpp::export]]
+std::string cpp_hash_vector(SEXP x, int nthreads = 1){
+    // returns the key: type + length + hash of the content
+
+    int n = Rf_length(x);
+    int type = TYPEOF(x);
+    bool is_int64 = type == REALSXP && Rf_inherits(x, "integer64");
+
+    unsigned long long h;
+    if(type == REALSXP){
+        h = quf_hash_chunks(REAL(x), n, nthreads);
+    } else if(type == INTSXP || type == LGLSXP){
+        h = quf_hash_chunks(INTEGER(x), n, nthreads);
+    } else if(type == STRSXP){
+        vector<const char *> x_ptr(n);
+        for(int i=0 ; i<n ; ++i){
+            x_ptr[i] = CHAR(STRING_ELT(x, i));
+        }
+        h = quf_hash_chunks(x_ptr.data(), n, nthreads);
+    } else {
+        stop("cpp_hash_vector: the vector must be numeric or character.");
+    }
+
+    char key[64];
+    snprintf(key, sizeof(key), "%d%s_%d_%016llx", type, is_int64 ? "i64" : "", n, h);
+
+    return std::string(key);
+}
+
+//
+// Level dictionary
+//
+
+// To map new data onto the levels of an estimation (e.g. the fixed-effects in predict),
+// the levels are stored in a hash table which is kept in an external pointer.
+// The dictionary can then be used for any number of new vectors without being rebuilt.
+// Keys: the pointers for the strings (R stores the strings in a unique location; the levels
+// are protected by the pointer so they stay alive), the bits of the 64 bits integers for
+// integer64, and the bits of the double for the other numeric values.
+// R stores the same text in different encodings in different locations: the key of a
+// non-ASCII string is the pointer of its UTF-8 version (as factor() would match them).
+// The keys are built serially (the R API must not be called from the threads: e.g.
+// STRING_ELT allocates for deferred strings), only the lookups are multi-threaded.
+
+struct QUF_DICT{
+    // type: 0: numeric, 1: string, 2: integer64
+    int type;
+    // level_id: from the id in the table to the position of the level (starting at 1)
+    vector<int> level_id;
+    QUF_TABLE table;
+
+    QUF_DICT(int type, int n) : type(type), table(n) {}
+};
+
+int quf_dict_type(SEXP x){
+    if(TYPEOF(x) == STRSXP) return 1;
+    if(TYPEOF(x) == REALSXP && Rf_inherits(x, "integer64")) return 2;
+    if(TYPEOF(x) == REALSXP || TYPEOF(x) == INTSXP || TYPEOF(x) == LGLSXP) return 0;
+    stop("The values of the dictionary must be numeric or character.");
+    return 0;
+}
+
+inline SEXP quf_dict_utf8(SEXP xi){
+    // the UTF-8 version of a string (ASCII strings are left as is)
+
+    cetype_t enc = Rf_getCharCE(xi);
+    if(enc == CE_UTF8 || enc == CE_BYTES) return xi;
+
+    for(const char *p = CHAR(xi) ; *p ; ++p){
+        if(static_cast<unsigned char>(*p) > 127){
+            return Rf_mkCharCE(Rf_translateCharUTF8(xi), CE_UTF8);
+        }
+    }
+
+    return xi;
+}
+
+void quf_dict_keys(SEXP x, int type, SEXP x_utf8, vector<unsigned long long> &x_key, vector<char> &is_na){
+    // x_utf8: strings only, a vector of the same length as x, protected by the caller,
+    //         which keeps the UTF-8 versions alive (their pointers are the keys)
+
+    int n = Rf_length(x);
+    x_key.resize(n);
+    is_na.assign(n, 0);
+
+    if(type == 1){
+        for(int i=0 ; i<n ; ++i){
+            SEXP xi = STRING_ELT(x, i);
+            if(xi == NA_STRING){
+                is_na[i] = 1;
+                continue;
+            }
+            xi = quf_dict_utf8(xi);
+            SET_STRING_ELT(x_utf8, i, xi);
+            x_key[i] = static_cast<unsigned long long>(reinterpret_cast<std::uintptr_t>(CHAR(xi)));
+        }
+    } else if(type == 2){
+        memcpy(x_key.data(), REAL(x), n * sizeof(double));
+        // NA: the lowest integer
+        for(int i=0 ; i<n ; ++i){
+            if(x_key[i] == 0x8000000000000000ULL) is_na[i] = 1;
+        }
+    } else {
+        bool is_double = TYPEOF(x) == REALSXP;
+        const double *px_dble = is_double ? REAL(x) : nullptr;
+        const int *px_int = is_double ? nullptr : INTEGER(x);
+        for(int i=0 ; i<n ; ++i){
+            double xi;
+            if(is_double){
+                xi = px_dble[i];
+                if(ISNAN(xi)){
+                    is_na[i] = 1;
+                    continue;
+                }
+            } else {
+                if(px_int[i] == NA_INTEGER){
+                    is_na[i] = 1;
+                    continue;
+                }
+                xi = px_int[i];
+            }
+
+            // -0 == 0
+            if(xi == 0){
+                x_key[i] = 0;
+            } else {
+                memcpy(&x_key[i], &xi, sizeof(double));
+            }
+        }
+    }
+}
+
+QUF_DICT *quf_dict_get(SEXP dict){
+    // the pointer is NULL if the dictionary was saved and reloaded
+    QUF_DICT *d = (QUF_DICT *) R_ExternalPtrAddr(dict);
+    if(d == nullptr){
+        stop("The dictionary is not valid anymore.");
+    }
+    return d;
+}
+
+// [[Rcpp::export]]
+SEXP cpp_quf_dict(SEXP x){
+    // x: the levels (e.g. x_unik from cpp_quf_gnl, or the strings)
+
+    int n = Rf_length(x);
+    int type = quf_dict_type(x);
+
+    SEXP x_utf8 = PROTECT(Rf_allocVector(STRSXP, type == 1 ? n : 0));
+    vector<unsigned long long> x_key;
+    vector<char> is_na;
+    quf_dict_keys(x, type, x_utf8, x_key, is_na);
+
+    QUF_DICT *d = new QUF_DICT(type, n);
+
+    bool is_new;
+    for(int i=0 ; i<n ; ++i){
+        if(is_na[i]) continue;
+
+        d->table.get_id(x_key[i], quf_hash(x_key[i]), is_new);
+        // in case of duplicates: the first level is kept
+        if(is_new) d->level_id.push_back(i + 1);
+    }
+
+    // the levels are protected: the pointers of the strings must stay valid
+    XPtr<QUF_DICT> res(d, true, R_NilValue, type == 1 ? x_utf8 : x);
+    UNPROTECT(1);
+
+    return res;
+}
+
+// [[Rcpp::export]]
+bool cpp_quf_dict_valid(SEXP dict){
+    return R_ExternalPtrAddr(dict) != nullptr;
+}
+
+// [[Rcpp::export]]
+IntegerVector cpp_quf_dict_match(SEXP dict, SEXP x, int nthreads = 1){
+    // the position of the values of x in the levels, NA if absent
+    // the values of x must be of the same type as the levels (numeric: int or double)
+
+    QUF_DICT *d = quf_dict_get(dict);
+
+    int n = Rf_length(x);
+    int type = quf_dict_type(x);
+    if(type != d->type){
+        stop("The values to match are not of the same type as the levels of the dictionary.");
+    }
+
+    SEXP x_utf8 = PROTECT(Rf_allocVector(STRSXP, type == 1 ? n : 0));
+    vector<unsigned long long> x_key;
+    vector<char> is_na;
+    quf_dict_keys(x, type, x_utf8, x_key, is_na);
+
+    if(n < QUF_PAR_MIN) nthreads = 1;
+
+    IntegerVector res(n);
+    int *pres = res.begin();
+    const QUF_TABLE &table = d->table;
+    const int *plevel_id = d->level_id.data();
+    const unsigned long long *px_key = x_key.data();
+    const char *pis_na = is_na.data();
+
+    #pragma omp parallel for num_threads(nthreads)
+    for(int i=0 ; i<n ; ++i){
+        int id = pis_na[i] ? 0 : table.find(px_key[i], quf_hash(px_key[i]));
+        pres[i] = id == 0 ? NA_INTEGER : plevel_id[id - 1];
+    }
+
+    UNPROTECT(1);
+
+    return res;
+}
+
+
+//
+// Panel index
+//
 
+// Index of a panel, used to lag/lead variables.
+// The observations are sorted by (id, time) with the radix sort: the id is in the high bits
+// of the key and the time in the low bits. Since the sort is stable, the order is the
+// same as the one of R's order(id, time).
+// In the sorted data, each id is a run of consecutive observations. When the times of a run
+// are consecutive (no gap, no duplicate), the run is balanced: the lag of order k is simply
+// the observation k rows above. Otherwise, the lagged time is found with a binary search.
+
+template<typename T>
+void panel_sort(int n, const int *pid, const int *ptime, int time_min, int time_bits,
+                int *porder_it, int *porder_inv, int *pid_sorted, int *ptime_sorted, int nthreads){
+    // the outputs are R style
+    // the sorted ids and times are decoded from the sorted keys: no random access
+
+    vector<T> x_key(n), x_tmp(n);
+    vector<int> x_order(n), o_tmp(n);
+    #pragma omp parallel for num_threads(nthreads)
+    for(int i=0 ; i<n ; ++i){
+        T t = static_cast<T>(static_cast<long long>(ptime[i]) - time_min);
+        x_key[i] = (static_cast<T>(pid[i] - 1) << time_bits) | t;
+        x_order[i] = i;
+    }
+
+    T *x_read = x_key.data(), *x_write = x_tmp.data();
+    int *o_read = x_order.data(), *o_write = o_tmp.data();
+    if(n > 1) radix_sort(n, x_read, x_write, o_read, o_write, nthreads);
+
+    const T time_mask = (static_cast<T>(1) << time_bits) - 1;
+    #pragma omp parallel for num_threads(nthreads)
+    for(int i=0 ; i<n ; ++i){
+        int obs = o_read[i];
+        porder_it[i] = obs + 1;
+        porder_inv[obs] = i + 1;
+        pid_sorted[i] = static_cast<int>(x_read[i] >> time_bits) + 1;
+        ptime_sorted[i] = static_cast<int>(static_cast<long long>(x_read[i] & time_mask) + time_min);
+    }
+}
+
+inline int bits_needed(unsigned long long x){
+    // number of bits to store the values from 0 to x
+    int n_bits = 0;
+    while((x >> n_bits) != 0) ++n_bits;
+    return n_bits;
+}
+
+// [[Rcpp::export]]
+List cpp_panel_index(IntegerVector id, IntegerVector time, int nthreads = 1){
+    // id: ranges from 1 to n_id (some ids can be absent) // time: integers
+    // no NA in id nor in time
+    // run_start: start of the run of each id, 0-based, of length n_id + 1
+
+    int n = id.length();
+    if(n < QUF_PAR_MIN) nthreads = 1;
+
+    const int *pid = id.begin(), *ptime = time.begin();
+
+    int id_max = 0, time_min = n > 0 ? ptime[0] : 0, time_max = time_min;
+    for(int i=0 ; i<n ; ++i){
+        if(pid[i] < 1) stop("The panel identifiers must be strictly positive integers.");
+        if(pid[i] > id_max) id_max = pid[i];
+        if(ptime[i] < time_min){
+            time_min = ptime[i];
+        } else if(ptime[i] > time_max){
+            time_max = ptime[i];
+        }
+    }
+
+    int time_bits = bits_needed(static_cast<long long>(time_max) - time_min);
+
+    // 1) sorting
+    // 32 bits keys when possible: half the memory to move around
+
+    IntegerVector order_it(n), order_inv(n), id_sorted(n), time_sorted(n);
+    int *porder_it = order_it.begin(), *porder_inv = order_inv.begin();
+    int *pid_sorted = id_sorted.begin(), *ptime_sorted = time_sorted.begin();
+
+    if(bits_needed(id_max - 1) + time_bits < 32){
+        panel_sort<unsigned int>(n, pid, ptime, time_min, time_bits, porder_it, porder_inv,
+                                 pid_sorted, ptime_sorted, nthreads);
+    } else {
+        panel_sort<unsigned long long>(n, pid, ptime, time_min, time_bits, porder_it, porder_inv,
+                                       pid_sorted, ptime_sorted, nthreads);
+    }
+
+    // 2) runs + duplicates
+
+    vector<int> run_start(id_max + 1, 0);
+    vector<int> run_balanced(id_max, true);
+    int obs_dup = 0;
+
+    for(int i=0 ; i<n ; ++i) ++run_start[pid_sorted[i]];
+
+    for(int i=1 ; i<n ; ++i){
+        if(pid_sorted[i] == pid_sorted[i - 1]){
+            int diff_time = ptime_sorted[i] - ptime_sorted[i - 1];
+            if(diff_time != 1){
+                run_balanced[pid_sorted[i] - 1] = false;
+                // the first duplicate, R style
+                if(diff_time == 0 && obs_dup == 0) obs_dup = i;
+            }
+        }
+    }
+
+    // the counts (shifted by one) into starting positions
+    for(int g=1 ; g<=id_max ; ++g) run_start[g] += run_start[g - 1];
+
+    int n_dup = 0;
+    if(obs_dup > 0){
+        int i = obs_dup;
+        n_dup = 2;
+        while(++i < n && pid_sorted[i] == pid_sorted[obs_dup] && ptime_sorted[i] == ptime_sorted[obs_dup]) ++n_dup;
+    }
+
+    List res;
+    res["order_it"] = order_it;
+    res["order_inv"] = order_inv;
+    res["id_sorted"] = id_sorted;
+    res["time_sorted"] = time_sorted;
+    res["run_start"] = IntegerVector(run_start);
+    res["run_balanced"] = LogicalVector(run_balanced);
+    res["n_dup"] = n_dup;
+    res["obs_dup"] = obs_dup;
+
+    return res;
+}
+
+// [[Rcpp::export]]
+IntegerVector cpp_panel_lag(IntegerVector id_sorted, IntegerVector time_sorted, IntegerVector run_start,
+                            LogicalVector run_balanced, int k, int nthreads = 1){
+    // the observation (R style, in the sorted data) of the lag of order k of each observation
+    // k < 0: lead // NA if it does not exist
+    // the arguments come from cpp_panel_index
+    // duplicate times: the lag is the first observation of that time, the lead the last one
+
+    int n = id_sorted.length();
+    if(n < QUF_PAR_MIN) nthreads = 1;
+
+    const int *pid = id_sorted.begin(), *ptime = time_sorted.begin();
+    const int *prun_start = run_start.begin(), *pbalanced = run_balanced.begin();
+
+    IntegerVector res(n);
+    int *pres = res.begin();
+
+    #pragma omp parallel for num_threads(nthreads)
+    for(int i=0 ; i<n ; ++i){
+        int g = pid[i] - 1;
+        int start = prun_start[g], end = prun_start[g + 1];
+        int obs = NA_INTEGER;
+
+        if(k == 0){
+            obs = i + 1;
+        } else if(pbalanced[g]){
+            long long j = static_cast<long long>(i) - k;
+            if(j >= start && j < end) obs = j + 1;
+        } else {
+            long long time_lag = static_cast<long long>(ptime[i]) - k;
+            if(k > 0){
+                const int *p = std::lower_bound(ptime + start, ptime + end, time_lag);
+                if(p != ptime + end && *p == time_lag) obs = p - ptime + 1;
+            } else {
+                const int *p = std::upper_bound(ptime + start, ptime + end, time_lag);
+                if(p != ptime + start && *(p - 1) == time_lag) obs = p - ptime;
+            }
+        }
+
+        pres[i] = obs;
+    }
+
+    return res;
+}